@@ -20,9 +20,10 @@ LOCAL_PATH := $(_dir)
 
 include $(CLEAR_VARS)
 LOCAL_MODULE := libaxmlparser
-LOCAL_SRC_FILES := ResourceTypes.cpp
+LOCAL_SRC_FILES := ResourceTypes.cpp ZipFileRO.cpp
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/include
 LOCAL_STATIC_LIBRARIES := libutils
+LOCAL_EXPORT_LDLIBS := -lz
 include $(BUILD_STATIC_LIBRARY)
 
 ifneq ($(SKIP_EXAMPLES),true)
@@ -35,10 +36,11 @@ LOCAL_CFLAGS := -DPUGIXML_NO_EXCEPTIONS
 include $(BUILD_STATIC_LIBRARY)
 
 include $(CLEAR_VARS)
-LOCAL_SRC_FILES := axml2xml.cpp
+LOCAL_SRC_FILES := axml2xml.cpp xml_printer.cpp
 LOCAL_MODULE := axml2xml
 LOCAL_STATIC_LIBRARIES := libutils libaxmlparser libpugixml
 LOCAL_C_INCLUDES := include external/pugixml/src
+LOCAL_CFLAGS := -DWITH_PUGIXML
 LOCAL_LDFLAGS := -static
 include $(BUILD_EXECUTABLE)
 
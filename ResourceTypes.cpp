@@ -24,22 +24,84 @@
 #include <utils/String16.h>
 #include <utils/String8.h>
 
+#include <memory>
+#include <new>
+
 #include <stdlib.h>
 #include <string.h>
 #include <memory.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define STRING_POOL_NOISY(x) //x
 #define XML_NOISY(x) //x
 
 namespace android {
 
+// True when resource data can be read in place, as on every little-endian
+// host.  dtohs()/dtohl() are then no-ops and the swapping paths below are
+// compiled out.
+static const bool kDeviceEndian = BYTE_ORDER == DEVICE_BYTE_ORDER;
+
+void ResDiagnostics::clear()
+{
+    code = NONE;
+    offset = 0;
+    chunkType = RES_NULL_TYPE;
+    expected = 0;
+    actual = 0;
+}
+
+const char* ResDiagnostics::codeName(Code code)
+{
+    switch (code) {
+    case NONE:                      return "no error";
+    case CHUNK_HEADER_TOO_SMALL:    return "chunk header too small";
+    case CHUNK_SMALLER_THAN_HEADER: return "chunk smaller than its header";
+    case CHUNK_MISALIGNED:          return "chunk size not a multiple of 4";
+    case CHUNK_PAST_END:            return "chunk extends past end of data";
+    case ENTRIES_PAST_END:          return "string pool offsets extend past end of data";
+    case STRINGS_PAST_END:          return "string data starts past end of pool";
+    case STYLES_PAST_END:           return "style data starts past end of pool";
+    case STYLES_BEFORE_STRINGS:     return "style data starts before string data";
+    case EMPTY_STRING_POOL:         return "string pool has no string data";
+    case STRINGS_NOT_TERMINATED:    return "last string not terminated";
+    case STYLES_NOT_TERMINATED:     return "last style not terminated";
+    case NODE_TOO_SMALL:            return "XML node too small";
+    case ATTRIBUTES_PAST_END:       return "XML attributes extend past end of node";
+    case NO_ROOT_ELEMENT:           return "no root element";
+    }
+    return "unknown error";
+}
+
+// Fills in diag unless there is none or it already holds an error.  Only
+// failed checks call this, so valid data never pays for diagnostics.
+static void report(ResDiagnostics* diag, ResDiagnostics::Code code,
+                   const void* base, const void* chunk, uint16_t chunkType,
+                   uint64_t expected, uint64_t actual)
+{
+    if (diag == NULL || diag->code != ResDiagnostics::NONE) {
+        return;
+    }
+    diag->code = code;
+    diag->offset = ((const uint8_t*)chunk)-((const uint8_t*)base);
+    diag->chunkType = chunkType;
+    diag->expected = expected;
+    diag->actual = actual;
+}
+
 static status_t validate_chunk(const ResChunk_header* chunk,
                                size_t minSize,
                                const uint8_t* dataEnd,
-                               const char* name)
+                               const char* name,
+                               ResDiagnostics* diag = NULL,
+                               const void* base = NULL)
 {
     const uint16_t headerSize = dtohs(chunk->headerSize);
     const uint32_t size = dtohl(chunk->size);
@@ -52,21 +114,66 @@ static status_t validate_chunk(const ResChunk_header* chunk,
                 }
                 ALOGW("%s data size 0x%x extends beyond resource end %p.",
                      name, size, (void*)(dataEnd-((const uint8_t*)chunk)));
+                report(diag, ResDiagnostics::CHUNK_PAST_END, base, chunk,
+                       dtohs(chunk->type), dataEnd-((const uint8_t*)chunk), size);
                 return BAD_TYPE;
             }
             ALOGW("%s size 0x%x or headerSize 0x%x is not on an integer boundary.",
                  name, (int)size, (int)headerSize);
+            const uint32_t misaligned = (headerSize&0x3) ? headerSize : size;
+            report(diag, ResDiagnostics::CHUNK_MISALIGNED, base, chunk,
+                   dtohs(chunk->type), (misaligned+3)&~(uint64_t)0x3, misaligned);
             return BAD_TYPE;
         }
         ALOGW("%s size 0x%x is smaller than header size 0x%x.",
              name, size, headerSize);
+        report(diag, ResDiagnostics::CHUNK_SMALLER_THAN_HEADER, base, chunk,
+               dtohs(chunk->type), headerSize, size);
         return BAD_TYPE;
     }
     ALOGW("%s header size 0x%04x is too small.",
          name, headerSize);
+    report(diag, ResDiagnostics::CHUNK_HEADER_TOO_SMALL, base, chunk,
+           dtohs(chunk->type), minSize, headerSize);
     return BAD_TYPE;
 }
 
+// Maps the file at path read-only.  Returns -errno if it cannot be opened
+// or mapped and BAD_TYPE if it is empty.
+static status_t map_file(const char* path, void** outData, size_t* outSize)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) {
+        const status_t err = -errno;
+        close(fd);
+        return err;
+    }
+    if (S_ISDIR(sb.st_mode)) {
+        close(fd);
+        return -EISDIR;
+    }
+    if (sb.st_size <= 0) {
+        close(fd);
+        return BAD_TYPE;
+    }
+
+    void* data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    const status_t mapErr = -errno;
+    close(fd);
+    if (data == MAP_FAILED) {
+        return mapErr;
+    }
+
+    *outData = data;
+    *outSize = sb.st_size;
+    return NO_ERROR;
+}
+
 inline void Res_value::copyFrom_dtoh(const Res_value& src)
 {
     size = dtohs(src.size);
@@ -80,14 +187,23 @@ inline void Res_value::copyFrom_dtoh(const Res_value& src)
 // --------------------------------------------------------------------
 
 ResStringPool::ResStringPool()
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mDiag(NULL), mDiagBase(NULL), mOwnedData(NULL)
+    , mHeader(NULL), mCache(NULL), mLockFreeCache(NULL), mArena(NULL)
+    , mArenaSize(0), mArenaUsed(0)
+    , mDecodedOffsets(NULL), mDecoded(NULL), mDecodedBytes(0), mDecodeTime(0)
+    , mUseStringIndex(false), mStringIndex(NULL), mHostStyles(NULL)
 {
 }
 
-ResStringPool::ResStringPool(const void* data, size_t size, bool copyData)
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+ResStringPool::ResStringPool(const void* data, size_t size, bool copyData,
+                             uint32_t flags)
+    : mError(NO_INIT), mDiag(NULL), mDiagBase(NULL), mOwnedData(NULL)
+    , mHeader(NULL), mCache(NULL), mLockFreeCache(NULL), mArena(NULL)
+    , mArenaSize(0), mArenaUsed(0)
+    , mDecodedOffsets(NULL), mDecoded(NULL), mDecodedBytes(0), mDecodeTime(0)
+    , mUseStringIndex(false), mStringIndex(NULL), mHostStyles(NULL)
 {
-    setTo(data, size, copyData);
+    setTo(data, size, copyData, flags);
 }
 
 ResStringPool::~ResStringPool()
@@ -111,17 +227,25 @@ void ResStringPool::setToEmpty()
     mHeader = (const ResStringPool_header*) header;
 }
 
-status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
+status_t ResStringPool::setTo(const void* data, size_t size, bool copyData,
+                              uint32_t flags)
 {
-    if (!data || !size) {
+    if (mDiag) {
+        mDiag->clear();
+    }
+
+    if (!data || size < sizeof(ResStringPool_header)) {
+        report(mDiag, ResDiagnostics::CHUNK_PAST_END,
+               mDiagBase ? mDiagBase : data, data, RES_STRING_POOL_TYPE,
+               size, sizeof(ResStringPool_header));
         return (mError=BAD_TYPE);
     }
 
     uninit();
 
-    const bool notDeviceEndian = htods(0xf0) != 0xf0;
+    mUseStringIndex = (flags&STRING_INDEX_FLAG) != 0;
 
-    if (copyData || notDeviceEndian) {
+    if (copyData) {
         mOwnedData = malloc(size);
         if (mOwnedData == NULL) {
             return (mError=NO_MEMORY);
@@ -131,23 +255,38 @@ status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
     }
 
     mHeader = (const ResStringPool_header*)data;
-
-    if (notDeviceEndian) {
-        ResStringPool_header* h = const_cast<ResStringPool_header*>(mHeader);
-        h->header.headerSize = dtohs(mHeader->header.headerSize);
-        h->header.type = dtohs(mHeader->header.type);
-        h->header.size = dtohl(mHeader->header.size);
-        h->stringCount = dtohl(mHeader->stringCount);
-        h->styleCount = dtohl(mHeader->styleCount);
-        h->flags = dtohl(mHeader->flags);
-        h->stringsStart = dtohl(mHeader->stringsStart);
-        h->stylesStart = dtohl(mHeader->stylesStart);
+    // Every check below is about this chunk
+    const void* diagBase = mDiagBase ? mDiagBase : data;
+#define REPORT(code, expected, actual) \
+    report(mDiag, ResDiagnostics::code, diagBase, data, RES_STRING_POOL_TYPE, \
+           (expected), (actual))
+
+    if (!kDeviceEndian) {
+        // Only the header is swapped up front.  The entries and the UTF-16
+        // string data are swapped as they are read, so the pool does not
+        // have to be copied.
+        const ResStringPool_header* h = mHeader;
+        mHostHeader.header.headerSize = dtohs(h->header.headerSize);
+        mHostHeader.header.type = dtohs(h->header.type);
+        mHostHeader.header.size = dtohl(h->header.size);
+        mHostHeader.stringCount = dtohl(h->stringCount);
+        mHostHeader.styleCount = dtohl(h->styleCount);
+        mHostHeader.flags = dtohl(h->flags);
+        mHostHeader.stringsStart = dtohl(h->stringsStart);
+        mHostHeader.stylesStart = dtohl(h->stylesStart);
+        mHeader = &mHostHeader;
     }
 
     if (mHeader->header.headerSize > mHeader->header.size
             || mHeader->header.size > size) {
         ALOGW("Bad string block: header size %d or total size %d is larger than data size %d\n",
                 (int)mHeader->header.headerSize, (int)mHeader->header.size, (int)size);
+        if (mHeader->header.headerSize > mHeader->header.size) {
+            REPORT(CHUNK_SMALLER_THAN_HEADER, mHeader->header.headerSize,
+                   mHeader->header.size);
+        } else {
+            REPORT(CHUNK_PAST_END, size, mHeader->header.size);
+        }
         return (mError=BAD_TYPE);
     }
     mSize = mHeader->header.size;
@@ -161,6 +300,8 @@ status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
             ALOGW("Bad string block: entry of %d items extends past data size %d\n",
                     (int)(mHeader->header.headerSize+(mHeader->stringCount*sizeof(uint32_t))),
                     (int)size);
+            REPORT(ENTRIES_PAST_END, size,
+                   mHeader->header.headerSize+(uint64_t)mHeader->stringCount*sizeof(uint32_t));
             return (mError=BAD_TYPE);
         }
 
@@ -176,6 +317,7 @@ status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
         if (mHeader->stringsStart >= (mSize - sizeof(uint16_t))) {
             ALOGW("Bad string block: string pool starts at %d, after total size %d\n",
                     (int)mHeader->stringsStart, (int)mHeader->header.size);
+            REPORT(STRINGS_PAST_END, mSize - sizeof(uint16_t), mHeader->stringsStart);
             return (mError=BAD_TYPE);
         }
 
@@ -189,12 +331,14 @@ status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
             if (mHeader->stylesStart >= (mSize - sizeof(uint16_t))) {
                 ALOGW("Bad style block: style block starts at %d past data size of %d\n",
                     (int)mHeader->stylesStart, (int)mHeader->header.size);
+                REPORT(STYLES_PAST_END, mSize - sizeof(uint16_t), mHeader->stylesStart);
                 return (mError=BAD_TYPE);
             }
             // check invariant: styles follow the strings
             if (mHeader->stylesStart <= mHeader->stringsStart) {
                 ALOGW("Bad style block: style block starts at %d, before strings at %d\n",
                     (int)mHeader->stylesStart, (int)mHeader->stringsStart);
+                REPORT(STYLES_BEFORE_STRINGS, mHeader->stringsStart, mHeader->stylesStart);
                 return (mError=BAD_TYPE);
             }
             mStringPoolSize =
@@ -204,29 +348,16 @@ status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
         // check invariant: stringCount > 0 requires a string pool to exist
         if (mStringPoolSize == 0) {
             ALOGW("Bad string block: stringCount is %d but pool size is 0\n", (int)mHeader->stringCount);
+            REPORT(EMPTY_STRING_POOL, mHeader->stringCount, 0);
             return (mError=BAD_TYPE);
         }
 
-        if (notDeviceEndian) {
-            size_t i;
-            uint32_t* e = const_cast<uint32_t*>(mEntries);
-            for (i=0; i<mHeader->stringCount; i++) {
-                e[i] = dtohl(mEntries[i]);
-            }
-            if (!(mHeader->flags&ResStringPool_header::UTF8_FLAG)) {
-                const uint16_t* strings = (const uint16_t*)mStrings;
-                uint16_t* s = const_cast<uint16_t*>(strings);
-                for (i=0; i<mStringPoolSize; i++) {
-                    s[i] = dtohs(strings[i]);
-                }
-            }
-        }
-
         if ((mHeader->flags&ResStringPool_header::UTF8_FLAG &&
                 ((uint8_t*)mStrings)[mStringPoolSize-1] != 0) ||
                 (!mHeader->flags&ResStringPool_header::UTF8_FLAG &&
                 ((uint16_t*)mStrings)[mStringPoolSize-1] != 0)) {
             ALOGW("Bad string block: last string is not 0-terminated\n");
+            REPORT(STRINGS_NOT_TERMINATED, 0, 0);
             return (mError=BAD_TYPE);
         }
     } else {
@@ -239,13 +370,19 @@ status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
         // invariant: integer overflow in calculating mEntryStyles
         if (mEntryStyles < mEntries) {
             ALOGW("Bad string block: integer overflow finding styles\n");
+            REPORT(ENTRIES_PAST_END, size, UINT64_MAX);
             return (mError=BAD_TYPE);
         }
 
-        if (((const uint8_t*)mEntryStyles-(const uint8_t*)mHeader) > (int)size) {
+        // All of the style entries must fit, not only the first one
+        const size_t entryStylesEnd =
+            ((const uint8_t*)mEntryStyles-(const uint8_t*)data)
+            + mHeader->styleCount*sizeof(uint32_t);
+        if ((mHeader->styleCount*sizeof(uint32_t) < mHeader->styleCount)  // uint32 overflow?
+            || entryStylesEnd > size) {
             ALOGW("Bad string block: entry of %d styles extends past data size %d\n",
-                    (int)((const uint8_t*)mEntryStyles-(const uint8_t*)mHeader),
-                    (int)size);
+                    (int)entryStylesEnd, (int)size);
+            REPORT(ENTRIES_PAST_END, size, entryStylesEnd);
             return (mError=BAD_TYPE);
         }
         mStyles = (const uint32_t*)
@@ -253,23 +390,12 @@ status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
         if (mHeader->stylesStart >= mHeader->header.size) {
             ALOGW("Bad string block: style pool starts %d, after total size %d\n",
                     (int)mHeader->stylesStart, (int)mHeader->header.size);
+            REPORT(STYLES_PAST_END, mHeader->header.size, mHeader->stylesStart);
             return (mError=BAD_TYPE);
         }
         mStylePoolSize =
             (mHeader->header.size-mHeader->stylesStart)/sizeof(uint32_t);
 
-        if (notDeviceEndian) {
-            size_t i;
-            uint32_t* e = const_cast<uint32_t*>(mEntryStyles);
-            for (i=0; i<mHeader->styleCount; i++) {
-                e[i] = dtohl(mEntryStyles[i]);
-            }
-            uint32_t* s = const_cast<uint32_t*>(mStyles);
-            for (i=0; i<mStylePoolSize; i++) {
-                s[i] = dtohl(mStyles[i]);
-            }
-        }
-
         const ResStringPool_span endSpan = {
             { htodl(ResStringPool_span::END) },
             htodl(ResStringPool_span::END), htodl(ResStringPool_span::END)
@@ -277,15 +403,76 @@ status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
         if (memcmp(&mStyles[mStylePoolSize-(sizeof(endSpan)/sizeof(uint32_t))],
                    &endSpan, sizeof(endSpan)) != 0) {
             ALOGW("Bad string block: last style is not 0xFFFFFFFF-terminated\n");
+            REPORT(STYLES_NOT_TERMINATED, 0, 0);
             return (mError=BAD_TYPE);
         }
+
+        if (!kDeviceEndian) {
+            // styleAt() hands out pointers to the spans themselves, so the
+            // style data, unlike the strings, is swapped into a copy.
+            uint32_t* s = (uint32_t*)malloc(mStylePoolSize*sizeof(uint32_t));
+            if (s == NULL) {
+                return (mError=NO_MEMORY);
+            }
+            for (size_t i=0; i<mStylePoolSize; i++) {
+                s[i] = dtohl(mStyles[i]);
+            }
+            mHostStyles = s;
+            mStyles = s;
+        }
     } else {
         mEntryStyles = NULL;
         mStyles = NULL;
         mStylePoolSize = 0;
     }
 
+    if (mHeader->stringCount > 0
+            && (mHeader->flags&ResStringPool_header::UTF8_FLAG)) {
+        status_t err = NO_ERROR;
+        if (flags&EAGER_DECODE_FLAG) {
+            err = decodeAll();
+        }
+        if (err == NO_ERROR && mDecoded == NULL && (flags&LOCK_FREE_CACHE_FLAG)) {
+            err = initLockFreeCache();
+        }
+        if (err != NO_ERROR) {
+            return (mError=err);
+        }
+    }
+
     return (mError=NO_ERROR);
+#undef REPORT
+}
+
+void ResStringPool::setDiagnostics(ResDiagnostics* diag, const void* base)
+{
+    mDiag = diag;
+    mDiagBase = base;
+}
+
+status_t ResStringPool::initLockFreeCache()
+{
+    // The UTF-16 form of a string, including its terminator, never needs
+    // more units than the bytes the string occupies in the pool (length
+    // prefixes, UTF-8 data and terminator), so an arena with one char16_t
+    // per pool byte can hold every string in the pool.
+    const size_t slotBytes = mHeader->stringCount*sizeof(std::atomic<char16_t*>);
+    const size_t arenaSize = mStringPoolSize;
+    void* block = calloc(1, slotBytes + arenaSize*sizeof(char16_t));
+    if (block == NULL) {
+        ALOGW("No memory trying to allocate lock-free decode cache of %d bytes\n",
+                (int)(slotBytes + arenaSize*sizeof(char16_t)));
+        return NO_MEMORY;
+    }
+
+    mLockFreeCache = (std::atomic<char16_t*>*)block;
+    for (size_t i = 0; i < mHeader->stringCount; i++) {
+        new (&mLockFreeCache[i]) std::atomic<char16_t*>(NULL);
+    }
+    mArena = (char16_t*)(((uint8_t*)block) + slotBytes);
+    mArenaSize = arenaSize;
+    mArenaUsed.store(0, std::memory_order_relaxed);
+    return NO_ERROR;
 }
 
 status_t ResStringPool::getError() const
@@ -306,6 +493,37 @@ void ResStringPool::uninit()
         free(mCache);
         mCache = NULL;
     }
+    if (mHeader != NULL && mLockFreeCache != NULL) {
+        if (mArenaUsed.load(std::memory_order_relaxed) > mArenaSize) {
+            // The arena ran out at some point and the remaining strings were
+            // allocated individually.
+            char16_t* const arenaEnd = mArena + mArenaSize;
+            for (size_t x = 0; x < mHeader->stringCount; x++) {
+                char16_t* str = mLockFreeCache[x].load(std::memory_order_relaxed);
+                if (str != NULL && (str < mArena || str >= arenaEnd)) {
+                    free(str);
+                }
+            }
+        }
+        free(mLockFreeCache);
+        mLockFreeCache = NULL;
+        mArena = NULL;
+        mArenaSize = 0;
+        mArenaUsed.store(0, std::memory_order_relaxed);
+    }
+    if (mDecodedOffsets != NULL) {
+        free(mDecodedOffsets);
+        mDecodedOffsets = NULL;
+        mDecoded = NULL;
+        mDecodedBytes = 0;
+        mDecodeTime = 0;
+    }
+    free(mStringIndex.exchange(NULL, std::memory_order_relaxed));
+    mUseStringIndex = false;
+    if (mHostStyles) {
+        free(mHostStyles);
+        mHostStyles = NULL;
+    }
     if (mOwnedData) {
         free(mOwnedData);
         mOwnedData = NULL;
@@ -325,10 +543,10 @@ void ResStringPool::uninit()
 static inline size_t
 decodeLength(const uint16_t** str)
 {
-    size_t len = **str;
+    size_t len = dtohs(**str);
     if ((len & 0x8000) != 0) {
         (*str)++;
-        len = ((len & 0x7FFF) << 16) | **str;
+        len = ((len & 0x7FFF) << 16) | dtohs(**str);
     }
     (*str)++;
     return len;
@@ -356,11 +574,88 @@ decodeLength(const uint8_t** str)
     return len;
 }
 
+status_t ResStringPool::decodeAll()
+{
+    const nsecs_t startTime = systemTime();
+    const uint8_t* strings = (const uint8_t*)mStrings;
+    const size_t N = mHeader->stringCount;
+
+    // Size the buffer from the length prefixes.  Strings that do not share
+    // data need at most one char16_t per pool byte; anything larger means
+    // entries overlap, and decoding them separately could blow up, so leave
+    // such pools to the lazy path.
+    size_t total = 0;
+    for (size_t i = 0; i < N; i++) {
+        const uint32_t off = dtohl(mEntries[i]);
+        if (off < (mStringPoolSize-1)) {
+            const uint8_t* u8str = strings+off;
+            total += decodeLength(&u8str) + 1;
+        }
+    }
+    if (total > (size_t)mStringPoolSize + N) {
+        ALOGI("Not decoding string pool eagerly: %d strings need %d chars, pool has %d bytes\n",
+                (int)N, (int)total, (int)mStringPoolSize);
+        return NO_ERROR;
+    }
+
+    const size_t bytes = (N+1)*sizeof(uint32_t) + total*sizeof(char16_t);
+    mDecodedOffsets = (uint32_t*)malloc(bytes);
+    if (mDecodedOffsets == NULL) {
+        ALOGW("No memory trying to allocate decoded string pool of %d bytes\n", (int)bytes);
+        return NO_MEMORY;
+    }
+    mDecoded = (char16_t*)(mDecodedOffsets + N + 1);
+
+    uint32_t pos = 0;
+    for (size_t i = 0; i < N; i++) {
+        mDecodedOffsets[i] = pos;
+
+        const uint32_t off = dtohl(mEntries[i]);
+        if (off >= (mStringPoolSize-1)) {
+            ALOGW("Bad string block: string #%d entry is at %d, past end at %d\n",
+                    (int)i, (int)off, (int)mStringPoolSize);
+            continue;
+        }
+        const uint8_t* u8str = strings+off;
+        const size_t u16len = decodeLength(&u8str);
+        const size_t u8len = decodeLength(&u8str);
+        if ((uint32_t)(u8str+u8len-strings) >= mStringPoolSize) {
+            ALOGW("Bad string block: string #%lld extends to %lld, past end at %lld\n",
+                    (long long)i, (long long)(u8str+u8len-strings),
+                    (long long)mStringPoolSize);
+            continue;
+        }
+        ssize_t actualLen = utf8_to_utf16_length(u8str, u8len);
+        if (actualLen < 0 || (size_t)actualLen != u16len) {
+            ALOGW("Bad string block: string #%lld decoded length is not correct "
+                    "%lld vs %llu\n",
+                    (long long)i, (long long)actualLen, (long long)u16len);
+            continue;
+        }
+        utf8_to_utf16(u8str, u8len, mDecoded+pos);
+        pos += u16len+1;
+    }
+    mDecodedOffsets[N] = pos;
+
+    mDecodedBytes = bytes;
+    mDecodeTime = systemTime() - startTime;
+    return NO_ERROR;
+}
+
 const char16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
 {
     if (mError == NO_ERROR && idx < mHeader->stringCount) {
+        if (mDecoded != NULL) {
+            const uint32_t start = mDecodedOffsets[idx];
+            const uint32_t end = mDecodedOffsets[idx+1];
+            if (end > start) {
+                *u16len = end-start-1;
+                return mDecoded+start;
+            }
+            return NULL;
+        }
         const bool isUTF8 = (mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0;
-        const uint32_t off = mEntries[idx]/(isUTF8?sizeof(uint8_t):sizeof(uint16_t));
+        const uint32_t off = dtohl(mEntries[idx])/(isUTF8?sizeof(uint8_t):sizeof(uint16_t));
         if (off < (mStringPoolSize-1)) {
             if (!isUTF8) {
                 const uint16_t* strings = (uint16_t*)mStrings;
@@ -368,7 +663,10 @@ const char16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
 
                 *u16len = decodeLength(&str);
                 if ((uint32_t)(str+*u16len-strings) < mStringPoolSize) {
-                    return reinterpret_cast<const char16_t*>(str);
+                    if (kDeviceEndian) {
+                        return reinterpret_cast<const char16_t*>(str);
+                    }
+                    return swapToCache(idx, str, *u16len);
                 } else {
                     ALOGW("Bad string block: string #%d extends to %d, past end at %d\n",
                             (int)idx, (int)(str+*u16len-strings), (int)mStringPoolSize);
@@ -382,23 +680,14 @@ const char16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
 
                 // encLen must be less than 0x7FFF due to encoding.
                 if ((uint32_t)(u8str+u8len-strings) < mStringPoolSize) {
+                    if (mLockFreeCache != NULL) {
+                        return decodeLockFree(idx, u8str, u8len, *u16len);
+                    }
+
                     std::lock_guard<std::mutex> lock(mDecodeLock);
 
-                    if (mCache == NULL) {
-#ifndef HAVE_ANDROID_OS
-                        STRING_POOL_NOISY(ALOGI("CREATING STRING CACHE OF %d bytes",
-                                mHeader->stringCount*sizeof(char16_t**)));
-#else
-                        // We do not want to be in this case when actually running Android.
-                        ALOGV("CREATING STRING CACHE OF %d bytes",
-                                mHeader->stringCount*sizeof(char16_t**));
-#endif
-                        mCache = (char16_t**)calloc(mHeader->stringCount, sizeof(char16_t**));
-                        if (mCache == NULL) {
-                            ALOGW("No memory trying to allocate decode cache table of %d bytes\n",
-                                    (int)(mHeader->stringCount*sizeof(char16_t**)));
-                            return NULL;
-                        }
+                    if (!allocCache()) {
+                        return NULL;
                     }
 
                     if (mCache[idx] != NULL) {
@@ -439,18 +728,115 @@ const char16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
     return NULL;
 }
 
+bool ResStringPool::allocCache() const
+{
+    if (mCache == NULL) {
+#ifndef HAVE_ANDROID_OS
+        STRING_POOL_NOISY(ALOGI("CREATING STRING CACHE OF %d bytes",
+                mHeader->stringCount*sizeof(char16_t**)));
+#else
+        // We do not want to be in this case when actually running Android.
+        ALOGV("CREATING STRING CACHE OF %d bytes",
+                mHeader->stringCount*sizeof(char16_t**));
+#endif
+        mCache = (char16_t**)calloc(mHeader->stringCount, sizeof(char16_t**));
+        if (mCache == NULL) {
+            ALOGW("No memory trying to allocate decode cache table of %d bytes\n",
+                    (int)(mHeader->stringCount*sizeof(char16_t**)));
+            return false;
+        }
+    }
+    return true;
+}
+
+const char16_t* ResStringPool::swapToCache(size_t idx, const uint16_t* str,
+                                           size_t u16len) const
+{
+    std::lock_guard<std::mutex> lock(mDecodeLock);
+
+    if (!allocCache()) {
+        return NULL;
+    }
+    if (mCache[idx] != NULL) {
+        return mCache[idx];
+    }
+
+    char16_t *u16str = (char16_t *)calloc(u16len+1, sizeof(char16_t));
+    if (!u16str) {
+        ALOGW("No memory when trying to allocate swap cache for string #%d\n",
+                (int)idx);
+        return NULL;
+    }
+    for (size_t i = 0; i < u16len; i++) {
+        u16str[i] = dtohs(str[i]);
+    }
+    mCache[idx] = u16str;
+    return u16str;
+}
+
+const char16_t* ResStringPool::decodeLockFree(size_t idx, const uint8_t* u8str,
+                                              size_t u8len, size_t u16len) const
+{
+    char16_t* cached = mLockFreeCache[idx].load(std::memory_order_acquire);
+    if (cached != NULL) {
+        return cached;
+    }
+
+    ssize_t actualLen = utf8_to_utf16_length(u8str, u8len);
+    if (actualLen < 0 || (size_t)actualLen != u16len) {
+        ALOGW("Bad string block: string #%lld decoded length is not correct "
+                "%lld vs %llu\n",
+                (long long)idx, (long long)actualLen, (long long)u16len);
+        return NULL;
+    }
+
+    // Each decoder gets a private piece of the arena, so concurrent decodes
+    // never write to the same memory.  The arena can only run out if several
+    // entries share the same string data or threads race on the same slot;
+    // fall back to the heap in that case.
+    char16_t* u16str;
+    const size_t start = mArenaUsed.fetch_add(u16len+1, std::memory_order_relaxed);
+    if (start + u16len + 1 <= mArenaSize) {
+        u16str = mArena + start;
+    } else {
+        u16str = (char16_t*)calloc(u16len+1, sizeof(char16_t));
+        if (!u16str) {
+            ALOGW("No memory when trying to allocate decode cache for string #%d\n",
+                    (int)idx);
+            return NULL;
+        }
+    }
+
+    STRING_POOL_NOISY(ALOGI("Caching UTF8 string: %s", u8str));
+    utf8_to_utf16(u8str, u8len, u16str);
+
+    char16_t* expected = NULL;
+    if (!mLockFreeCache[idx].compare_exchange_strong(expected, u16str,
+            std::memory_order_acq_rel, std::memory_order_acquire)) {
+        // Another thread published this string first; use its copy.  An
+        // arena piece is simply abandoned until uninit().
+        if (u16str < mArena || u16str >= mArena + mArenaSize) {
+            free(u16str);
+        }
+        return expected;
+    }
+    return u16str;
+}
+
 const char* ResStringPool::string8At(size_t idx, size_t* outLen) const
 {
     if (mError == NO_ERROR && idx < mHeader->stringCount) {
         if ((mHeader->flags&ResStringPool_header::UTF8_FLAG) == 0) {
             return NULL;
         }
-        const uint32_t off = mEntries[idx]/sizeof(char);
+        const uint32_t off = dtohl(mEntries[idx])/sizeof(char);
         if (off < (mStringPoolSize-1)) {
             const uint8_t* strings = (uint8_t*)mStrings;
             const uint8_t* str = strings+off;
-            *outLen = decodeLength(&str);
+            // The UTF-16 length comes first; callers want the UTF-8 length.
+            decodeLength(&str);
             size_t encLen = decodeLength(&str);
+            *outLen = encLen;
             if ((uint32_t)(str+encLen-strings) < mStringPoolSize) {
                 return (const char*)str;
             } else {
@@ -489,7 +875,7 @@ const ResStringPool_span* ResStringPool::styleAt(const ResStringPool_ref& ref) c
 const ResStringPool_span* ResStringPool::styleAt(size_t idx) const
 {
     if (mError == NO_ERROR && idx < mHeader->styleCount) {
-        const uint32_t off = (mEntryStyles[idx]/sizeof(uint32_t));
+        const uint32_t off = (dtohl(mEntryStyles[idx])/sizeof(uint32_t));
         if (off < mStylePoolSize) {
             return (const ResStringPool_span*)(mStyles+off);
         } else {
@@ -501,6 +887,107 @@ const ResStringPool_span* ResStringPool::styleAt(size_t idx) const
     return NULL;
 }
 
+// Open-addressing hash table over the raw data of every string in a pool:
+// UTF-8 bytes for UTF-8 pools, UTF-16 code units for UTF-16 pools.
+struct ResStringPool::StringIndex
+{
+    struct Slot
+    {
+        uint32_t hash;
+        uint32_t idx;       // string index + 1; 0 for an empty slot
+    };
+
+    size_t mask;
+    Slot slots[1];
+
+    // FNV-1a
+    static uint32_t hash(const void* data, size_t size)
+    {
+        const uint8_t* p = (const uint8_t*)data;
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < size; i++) {
+            h = (h ^ p[i]) * 16777619u;
+        }
+        return h;
+    }
+};
+
+// Returns the raw data of string idx in the pool's own encoding, without
+// decoding or caching anything.
+static const void* rawStringAt(const ResStringPool& pool, size_t idx,
+                               size_t* outBytes)
+{
+    size_t len;
+    if (pool.isUTF8()) {
+        const char* s = pool.string8At(idx, &len);
+        *outBytes = len;
+        return s;
+    }
+    const char16_t* s = pool.stringAt(idx, &len);
+    *outBytes = len*sizeof(char16_t);
+    return s;
+}
+
+const ResStringPool::StringIndex* ResStringPool::getStringIndex() const
+{
+    StringIndex* index = mStringIndex.load(std::memory_order_acquire);
+    if (index != NULL) {
+        return index;
+    }
+
+    // At most half full, so probe sequences stay short and always end at
+    // an empty slot.
+    const size_t N = mHeader->stringCount;
+    size_t capacity = 8;
+    while (capacity < N*2) {
+        capacity *= 2;
+    }
+    index = (StringIndex*)calloc(1,
+            sizeof(StringIndex) + (capacity-1)*sizeof(StringIndex::Slot));
+    if (index == NULL) {
+        ALOGW("No memory trying to allocate string index of %d slots\n",
+                (int)capacity);
+        return NULL;
+    }
+    index->mask = capacity - 1;
+
+    for (size_t i = 0; i < N; i++) {
+        size_t bytes;
+        const void* s = rawStringAt(*this, i, &bytes);
+        if (s == NULL) {
+            continue;
+        }
+        const uint32_t h = StringIndex::hash(s, bytes);
+        for (size_t j = h & index->mask; ; j = (j + 1) & index->mask) {
+            StringIndex::Slot& slot = index->slots[j];
+            if (slot.idx == 0) {
+                slot.hash = h;
+                slot.idx = i + 1;
+                break;
+            }
+            if (slot.hash != h) {
+                continue;
+            }
+            size_t otherBytes;
+            const void* other = rawStringAt(*this, slot.idx - 1, &otherBytes);
+            if (otherBytes == bytes && memcmp(other, s, bytes) == 0) {
+                // Duplicate string; like the linear search, report the
+                // last one.
+                slot.idx = i + 1;
+                break;
+            }
+        }
+    }
+
+    StringIndex* expected = NULL;
+    if (!mStringIndex.compare_exchange_strong(expected, index,
+            std::memory_order_acq_rel, std::memory_order_acquire)) {
+        free(index);
+        return expected;
+    }
+    return index;
+}
+
 ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
 {
     if (mError != NO_ERROR) {
@@ -509,6 +996,51 @@ ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
 
     size_t len;
 
+    const StringIndex* index = mUseStringIndex ? getStringIndex() : NULL;
+    if (index != NULL) {
+        const void* key = str;
+        size_t keyBytes = strLen*sizeof(char16_t);
+        char buf[256];
+        char* key8 = NULL;
+        if (isUTF8()) {
+            const ssize_t len8 = strLen > 0 ? utf16_to_utf8_length(str, strLen) : 0;
+            key8 = (size_t)len8 < sizeof(buf) ? buf : (char*)malloc(len8+1);
+            if (key8 == NULL) {
+                return NO_MEMORY;
+            }
+            if (len8 > 0) {
+                utf16_to_utf8(str, strLen, key8);
+            }
+            key = key8;
+            keyBytes = len8;
+        }
+
+        ssize_t result = NAME_NOT_FOUND;
+        const uint32_t h = StringIndex::hash(key, keyBytes);
+        for (size_t j = h & index->mask; index->slots[j].idx != 0;
+                j = (j + 1) & index->mask) {
+            const StringIndex::Slot& slot = index->slots[j];
+            if (slot.hash != h) {
+                continue;
+            }
+            size_t bytes;
+            const void* s = rawStringAt(*this, slot.idx - 1, &bytes);
+            // Compare against the original UTF-16 key for UTF-8 pools, since
+            // the conversion drops unpaired surrogates.
+            if (bytes == keyBytes && memcmp(s, key, bytes) == 0
+                    && (key8 == NULL || strzcmp16_utf8((const uint8_t*)s,
+                            bytes, str, strLen) == 0)) {
+                result = slot.idx - 1;
+                break;
+            }
+        }
+
+        if (key8 != buf) {
+            free(key8);
+        }
+        return result;
+    }
+
     if ((mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0) {
         STRING_POOL_NOISY(ALOGI("indexOfString UTF-8: %s", String8(str, strLen).string()));
 
@@ -517,10 +1049,9 @@ ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
         if (mHeader->flags&ResStringPool_header::SORTED_FLAG) {
             // Do a binary search for the string...  this is a little tricky,
             // because the strings are sorted with strzcmp16().  So to match
-            // the ordering, we need to convert strings in the pool to UTF-16.
-            // But we don't want to hit the cache, so instead we will have a
-            // local temporary allocation for the conversions.
-            char16_t* convBuffer = (char16_t*)malloc(strLen+4);
+            // the ordering, the strings in the pool are decoded to UTF-16 as
+            // they are compared, without converting them into a buffer or
+            // hitting the cache.
             ssize_t l = 0;
             ssize_t h = mHeader->stringCount-1;
 
@@ -530,9 +1061,7 @@ ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
                 const uint8_t* s = (const uint8_t*)string8At(mid, &len);
                 int c;
                 if (s != NULL) {
-                    char16_t* end = utf8_to_utf16_n(s, len, convBuffer, strLen+3);
-                    *end = 0;
-                    c = strzcmp16(convBuffer, end-convBuffer, str, strLen);
+                    c = strzcmp16_utf8(s, len, str, strLen);
                 } else {
                     c = -1;
                 }
@@ -540,7 +1069,6 @@ ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
                              (const char*)s, c, (int)l, (int)mid, (int)h));
                 if (c == 0) {
                     STRING_POOL_NOISY(ALOGI("MATCH!"));
-                    free(convBuffer);
                     return mid;
                 } else if (c < 0) {
                     l = mid + 1;
@@ -548,7 +1076,6 @@ ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
                     h = mid - 1;
                 }
             }
-            free(convBuffer);
         } else {
             // It is unusual to get the ID from an unsorted string block...
             // most often this happens because we want to get IDs for style
@@ -639,12 +1166,92 @@ bool ResStringPool::isUTF8() const
     return (mHeader->flags&ResStringPool_header::UTF8_FLAG)!=0;
 }
 
+nsecs_t ResStringPool::decodeTime() const
+{
+    return mDecodeTime;
+}
+
+size_t ResStringPool::decodedBytes() const
+{
+    return mDecodedBytes;
+}
+
 // --------------------------------------------------------------------
 // --------------------------------------------------------------------
 // --------------------------------------------------------------------
 
+// Open-addressing hash table from the resource IDs in a tree's resource map
+// to the index of the attribute name string that carries each ID.
+struct ResXMLTree::ResIdIndex
+{
+    // Several name strings share the ID; callers compare IDs instead.
+    static const uint32_t kShared = 0xfffffffe;
+    static const uint32_t kNotFound = 0xffffffff;
+
+    struct Slot
+    {
+        uint32_t resId;     // 0 for an empty slot
+        uint32_t nameIdx;
+    };
+
+    size_t mask;
+    Slot slots[1];
+
+    static size_t hash(uint32_t resId)
+    {
+        return (resId * 0x9e3779b1u) >> 7;
+    }
+
+    uint32_t find(uint32_t resId) const
+    {
+        for (size_t i = hash(resId) & mask; ; i = (i + 1) & mask) {
+            if (slots[i].resId == resId) {
+                return slots[i].nameIdx;
+            } else if (slots[i].resId == 0) {
+                return kNotFound;
+            }
+        }
+    }
+
+    static ResIdIndex* create(const uint32_t* resIds, size_t numResIds)
+    {
+        // At most half full, so probe sequences stay short and always end
+        // at an empty slot.
+        size_t capacity = 8;
+        while (capacity < numResIds*2) {
+            capacity *= 2;
+        }
+        ResIdIndex* index = (ResIdIndex*)calloc(1,
+                sizeof(ResIdIndex) + (capacity-1)*sizeof(Slot));
+        if (index == NULL) {
+            return NULL;
+        }
+        index->mask = capacity - 1;
+
+        for (size_t n = 0; n < numResIds; n++) {
+            const uint32_t resId = dtohl(resIds[n]);
+            if (resId == 0) {
+                continue;
+            }
+            for (size_t i = hash(resId) & index->mask; ;
+                    i = (i + 1) & index->mask) {
+                Slot& slot = index->slots[i];
+                if (slot.resId == 0) {
+                    slot.resId = resId;
+                    slot.nameIdx = n;
+                    break;
+                } else if (slot.resId == resId) {
+                    slot.nameIdx = kShared;
+                    break;
+                }
+            }
+        }
+        return index;
+    }
+};
+
 ResXMLParser::ResXMLParser(const ResXMLTree& tree)
-    : mTree(tree), mEventCode(BAD_DOCUMENT)
+    : mTree(tree), mEventCode(BAD_DOCUMENT), mEventIndex(-1)
 {
 }
 
@@ -652,6 +1259,7 @@ void ResXMLParser::restart()
 {
     mCurNode = NULL;
     mEventCode = mTree.mError == NO_ERROR ? START_DOCUMENT : BAD_DOCUMENT;
+    mEventIndex = -1;
 }
 const ResStringPool& ResXMLParser::getStrings() const
 {
@@ -665,6 +1273,19 @@ ResXMLParser::event_code_t ResXMLParser::getEventType() const
 
 ResXMLParser::event_code_t ResXMLParser::next()
 {
+    if (mTree.mIndexed && mEventIndex >= -1
+            && (mEventCode == START_DOCUMENT || mEventCode >= FIRST_CHUNK_CODE)) {
+        const size_t idx = mEventIndex + 1;
+        if (idx < mTree.mEvents.size()) {
+            setEvent(idx);
+            return mEventCode;
+        }
+        mEventIndex = mTree.mEvents.size();
+        mCurNode = NULL;
+        return (mEventCode=mTree.mEventsEnd);
+    }
+
+    mEventIndex = -2;
     if (mEventCode == START_DOCUMENT) {
         mCurNode = mTree.mRootNode;
         mCurExt = mTree.mRootExt;
@@ -786,6 +1407,29 @@ size_t ResXMLParser::getAttributeCount() const
     return 0;
 }
 
+ResXMLParser::AttributeView ResXMLParser::getAttributes() const
+{
+    AttributeView view;
+    if (mEventCode == START_TAG) {
+        const ResXMLTree_attrExt* tag = (const ResXMLTree_attrExt*)mCurExt;
+        view.mBase = ((const uint8_t*)tag) + dtohs(tag->attributeStart);
+        view.mStride = dtohs(tag->attributeSize);
+        view.mCount = dtohs(tag->attributeCount);
+    }
+    return view;
+}
+
+ResXMLParser::ResXMLAttribute ResXMLParser::AttributeView::read(const uint8_t* data)
+{
+    const ResXMLTree_attribute* attr = (const ResXMLTree_attribute*)data;
+    ResXMLAttribute out;
+    out.ns = dtohl(attr->ns.index);
+    out.name = dtohl(attr->name.index);
+    out.rawValue = dtohl(attr->rawValue.index);
+    out.typedValue.copyFrom_dtoh(attr->typedValue);
+    return out;
+}
+
 int32_t ResXMLParser::getAttributeNamespaceID(size_t idx) const
 {
     if (mEventCode == START_TAG) {
@@ -963,8 +1607,8 @@ ssize_t ResXMLParser::indexOfAttribute(const char16_t* ns, size_t nsLen,
                 const char* curAttr = getAttributeName8(i, &curAttrLen);
                 STRING_POOL_NOISY(ALOGI("  curNs=%s (%d), curAttr=%s (%d)", curNs, curNsLen,
                         curAttr, curAttrLen));
-                if (curAttr != NULL && curNsLen == nsLen && curAttrLen == attrLen
-                        && memcmp(attr8.string(), curAttr, attrLen) == 0) {
+                if (curAttr != NULL && curNsLen == ns8.size() && curAttrLen == attr8.size()
+                        && memcmp(attr8.string(), curAttr, curAttrLen) == 0) {
                     if (ns == NULL) {
                         if (curNs == NULL) {
                             STRING_POOL_NOISY(ALOGI("  FOUND!"));
@@ -973,7 +1617,7 @@ ssize_t ResXMLParser::indexOfAttribute(const char16_t* ns, size_t nsLen,
                     } else if (curNs != NULL) {
                         //printf(" --> ns=%s, curNs=%s\n",
                         //       String8(ns).string(), String8(curNs).string());
-                        if (memcmp(ns8.string(), curNs, nsLen) == 0) {
+                        if (memcmp(ns8.string(), curNs, curNsLen) == 0) {
                             STRING_POOL_NOISY(ALOGI("  FOUND!"));
                             return i;
                         }
@@ -1014,6 +1658,43 @@ ssize_t ResXMLParser::indexOfAttribute(const char16_t* ns, size_t nsLen,
     return NAME_NOT_FOUND;
 }
 
+ssize_t ResXMLParser::indexOfAttributeByResId(uint32_t resId) const
+{
+    if (mEventCode != START_TAG || resId == 0) {
+        return NAME_NOT_FOUND;
+    }
+
+    // Without an index (out of memory), compare every attribute's ID.
+    uint32_t nameIdx = ResXMLTree::ResIdIndex::kShared;
+    const ResXMLTree::ResIdIndex* index = mTree.getResIdIndex();
+    if (index != NULL) {
+        nameIdx = index->find(resId);
+        if (nameIdx == ResXMLTree::ResIdIndex::kNotFound) {
+            return NAME_NOT_FOUND;
+        }
+    }
+
+    const ResXMLTree_attrExt* tag = (const ResXMLTree_attrExt*)mCurExt;
+    const size_t N = dtohs(tag->attributeCount);
+    const size_t attrSize = dtohs(tag->attributeSize);
+    const uint8_t* attrs = ((const uint8_t*)tag) + dtohs(tag->attributeStart);
+    for (size_t i=0; i<N; i++) {
+        const ResXMLTree_attribute* attr =
+            (const ResXMLTree_attribute*)(attrs + attrSize*i);
+        const uint32_t curIdx = dtohl(attr->name.index);
+        if (nameIdx != ResXMLTree::ResIdIndex::kShared) {
+            if (curIdx == nameIdx) {
+                return i;
+            }
+        } else if (curIdx < mTree.mNumResIds
+                && dtohl(mTree.mResIds[curIdx]) == resId) {
+            return i;
+        }
+    }
+
+    return NAME_NOT_FOUND;
+}
+
 ssize_t ResXMLParser::indexOfID() const
 {
     if (mEventCode == START_TAG) {
@@ -1047,6 +1728,24 @@ ResXMLParser::event_code_t ResXMLParser::nextNode()
         return mEventCode;
     }
 
+    if (mTree.mValidated) {
+        // setTo() already validated every node up to mDataEnd.
+        do {
+            const ResXMLTree_node* next = (const ResXMLTree_node*)
+                (((const uint8_t*)mCurNode) + dtohl(mCurNode->header.size));
+            if (((const uint8_t*)next) >= mTree.mDataEnd) {
+                mCurNode = NULL;
+                return (mEventCode=END_DOCUMENT);
+            }
+            mCurNode = next;
+            mCurExt = ((const uint8_t*)next) + dtohs(next->header.headerSize);
+            const uint16_t type = dtohs(next->header.type);
+            if (type >= RES_XML_START_NAMESPACE_TYPE && type <= RES_XML_CDATA_TYPE) {
+                return (mEventCode=(event_code_t)type);
+            }
+        } while (true);
+    }
+
     do {
         const ResXMLTree_node* next = (const ResXMLTree_node*)
             (((const uint8_t*)mCurNode) + dtohl(mCurNode->header.size));
@@ -1094,6 +1793,8 @@ ResXMLParser::event_code_t ResXMLParser::nextNode()
                  (int)dtohs(next->header.type),
                  (int)(((const uint8_t*)next)-((const uint8_t*)mTree.mHeader)),
                  (int)(totalSize-headerSize), (int)minExtSize);
+            report(mTree.mDiag, ResDiagnostics::NODE_TOO_SMALL, mTree.mHeader, next,
+                   dtohs(next->header.type), minExtSize, totalSize-headerSize);
             return (mEventCode=BAD_DOCUMENT);
         }
 
@@ -1104,11 +1805,60 @@ ResXMLParser::event_code_t ResXMLParser::nextNode()
     } while (true);
 }
 
+ResXMLParser::event_code_t ResXMLParser::skipCurrentElement()
+{
+    if (mEventCode != START_TAG) {
+        return mEventCode;
+    }
+
+    if (mTree.mIndexed && mEventIndex >= 0) {
+        const int32_t match = mTree.mEvents[mEventIndex].match;
+        if (match >= 0) {
+            setEvent(match);
+            return mEventCode;
+        }
+        mEventIndex = mTree.mEvents.size();
+        mCurNode = NULL;
+        return (mEventCode=mTree.mEventsEnd);
+    }
+
+    // Count nesting using only the chunk headers; the START_TAG attribute
+    // checks in validateNode() are skipped.  The matching END_TAG itself is
+    // read by nextNode() as usual.
+    mEventIndex = -2;
+    const ResXMLTree_node* prev = mCurNode;
+    size_t depth = 1;
+    while (true) {
+        const ResXMLTree_node* node = (const ResXMLTree_node*)
+            (((const uint8_t*)prev) + dtohl(prev->header.size));
+        if (((const uint8_t*)node) >= mTree.mDataEnd) {
+            mCurNode = NULL;
+            return (mEventCode=END_DOCUMENT);
+        }
+        if (validate_chunk(&node->header, sizeof(ResXMLTree_node),
+                           mTree.mDataEnd, "ResXMLTree_node",
+                           mTree.mDiag, mTree.mHeader) != NO_ERROR) {
+            mCurNode = NULL;
+            return (mEventCode=BAD_DOCUMENT);
+        }
+
+        const uint16_t type = dtohs(node->header.type);
+        if (type == RES_XML_START_ELEMENT_TYPE) {
+            depth++;
+        } else if (type == RES_XML_END_ELEMENT_TYPE && --depth == 0) {
+            mCurNode = prev;
+            return nextNode();
+        }
+        prev = node;
+    }
+}
+
 void ResXMLParser::getPosition(ResXMLParser::ResXMLPosition* pos) const
 {
     pos->eventCode = mEventCode;
     pos->curNode = mCurNode;
     pos->curExt = mCurExt;
+    pos->eventIndex = mEventIndex;
 }
 
 void ResXMLParser::setPosition(const ResXMLParser::ResXMLPosition& pos)
@@ -1116,32 +1866,82 @@ void ResXMLParser::setPosition(const ResXMLParser::ResXMLPosition& pos)
     mEventCode = pos.eventCode;
     mCurNode = pos.curNode;
     mCurExt = pos.curExt;
+    mEventIndex = pos.eventIndex;
 }
 
-// --------------------------------------------------------------------
-
-static volatile int32_t gCount = 0;
-
-ResXMLTree::ResXMLTree()
-    : ResXMLParser(*this)
-    , mError(NO_INIT), mOwnedData(NULL)
+ssize_t ResXMLParser::getEventIndex() const
 {
-    //ALOGI("Creating ResXMLTree %p #%d\n", this, android_atomic_inc(&gCount)+1);
-    restart();
+    return mTree.mIndexed && mEventIndex >= 0
+            && (size_t)mEventIndex < mTree.mEvents.size() ? mEventIndex : -1;
 }
 
-ResXMLTree::~ResXMLTree()
+void ResXMLParser::setEvent(size_t idx)
 {
-    //ALOGI("Destroying ResXMLTree in %p #%d\n", this, android_atomic_dec(&gCount)-1);
-    uninit();
+    const ResXMLEvent& event = mTree.mEvents[idx];
+    mEventCode = event.eventCode;
+    mCurNode = event.node;
+    mCurExt = event.ext;
+    mEventIndex = idx;
 }
 
-status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData)
+status_t ResXMLParser::seekToEvent(size_t idx)
 {
-    uninit();
+    if (!mTree.mIndexed) {
+        return NO_INIT;
+    }
+    if (idx >= mTree.mEvents.size()) {
+        return BAD_INDEX;
+    }
+    setEvent(idx);
+    return NO_ERROR;
+}
+
+status_t ResXMLParser::seekToElement(size_t n)
+{
+    if (!mTree.mIndexed) {
+        return NO_INIT;
+    }
+    if (n >= mTree.mElements.size()) {
+        return BAD_INDEX;
+    }
+    setEvent(mTree.mElements[n]);
+    return NO_ERROR;
+}
+
+// --------------------------------------------------------------------
+
+static volatile int32_t gCount = 0;
+
+ResXMLTree::ResXMLTree()
+    : ResXMLParser(*this)
+    , mError(NO_INIT), mDiag(NULL), mOwnedData(NULL), mMappedData(NULL)
+    , mMappedSize(0), mHeader(NULL)
+    , mResIds(NULL), mNumResIds(0), mResIdIndex(NULL)
+    , mValidated(false), mIndexed(false), mEventsEnd(END_DOCUMENT)
+{
+    //ALOGI("Creating ResXMLTree %p #%d\n", this, android_atomic_inc(&gCount)+1);
+    restart();
+}
+
+ResXMLTree::~ResXMLTree()
+{
+    //ALOGI("Destroying ResXMLTree in %p #%d\n", this, android_atomic_dec(&gCount)-1);
+    uninit();
+}
+
+status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData,
+                           uint32_t flags)
+{
+    uninit();
     mEventCode = START_DOCUMENT;
 
-    if (!data || !size) {
+    if (mDiag) {
+        mDiag->clear();
+    }
+
+    if (!data || size < sizeof(ResXMLTree_header)) {
+        report(mDiag, ResDiagnostics::CHUNK_PAST_END, data, data, RES_XML_TYPE,
+               size, sizeof(ResXMLTree_header));
         return (mError=BAD_TYPE);
     }
 
@@ -1160,6 +1960,13 @@ status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData)
         ALOGW("Bad XML block: header size %d or total size %d is larger than data size %d\n",
              (int)dtohs(mHeader->header.headerSize),
              (int)dtohl(mHeader->header.size), (int)size);
+        if (dtohs(mHeader->header.headerSize) > mSize) {
+            report(mDiag, ResDiagnostics::CHUNK_SMALLER_THAN_HEADER, mHeader, mHeader,
+                   RES_XML_TYPE, dtohs(mHeader->header.headerSize), mSize);
+        } else {
+            report(mDiag, ResDiagnostics::CHUNK_PAST_END, mHeader, mHeader,
+                   RES_XML_TYPE, size, mSize);
+        }
         mError = BAD_TYPE;
         restart();
         return mError;
@@ -1167,6 +1974,7 @@ status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData)
     mDataEnd = ((const uint8_t*)mHeader) + mSize;
 
     mStrings.uninit();
+    mStrings.setDiagnostics(mDiag, mHeader);
     mRootNode = NULL;
     mResIds = NULL;
     mNumResIds = 0;
@@ -1178,7 +1986,8 @@ status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData)
     const ResChunk_header* lastChunk = chunk;
     while (((const uint8_t*)chunk) < (mDataEnd-sizeof(ResChunk_header)) &&
            ((const uint8_t*)chunk) < (mDataEnd-dtohl(chunk->size))) {
-        status_t err = validate_chunk(chunk, sizeof(ResChunk_header), mDataEnd, "XML");
+        status_t err = validate_chunk(chunk, sizeof(ResChunk_header), mDataEnd, "XML",
+                                      mDiag, mHeader);
         if (err != NO_ERROR) {
             mError = err;
             goto done;
@@ -1188,7 +1997,7 @@ status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData)
         XML_NOISY(printf("Scanning @ %p: type=0x%x, size=0x%x\n",
                      (void*)(((uint32_t)chunk)-((uint32_t)mHeader)), type, size));
         if (type == RES_STRING_POOL_TYPE) {
-            mStrings.setTo(chunk, size);
+            mStrings.setTo(chunk, size, false, flags);
         } else if (type == RES_XML_RESOURCE_MAP_TYPE) {
             mResIds = (const uint32_t*)
                 (((const uint8_t*)chunk)+dtohs(chunk->headerSize));
@@ -1218,30 +2027,206 @@ status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData)
 
     if (mRootNode == NULL) {
         ALOGW("Bad XML block: no root element node found\n");
+        report(mDiag, ResDiagnostics::NO_ROOT_ELEMENT, mHeader, mHeader,
+               RES_XML_TYPE, 0, 0);
         mError = BAD_TYPE;
         goto done;
     }
 
     mError = mStrings.getError();
 
+    if (mError == NO_ERROR && (flags&VALIDATE_ONCE_FLAG)) {
+        ResXMLParser parser(*this);
+        parser.restart();
+        event_code_t code;
+        while ((code=parser.next()) != END_DOCUMENT && code != BAD_DOCUMENT) {
+        }
+        mValidated = code == END_DOCUMENT;
+    }
+
 done:
     restart();
     return mError;
 }
 
+status_t ResXMLTree::setToFile(const char* path, uint32_t flags)
+{
+    uninit();
+
+    void* data = NULL;
+    size_t size = 0;
+    status_t err = map_file(path, &data, &size);
+    if (err == BAD_TYPE) {
+        // Empty file
+        return setTo(NULL, 0, false, flags);
+    } else if (err != NO_ERROR) {
+        return (mError=err);
+    }
+
+    // nextNode() only ever walks forward through the file.
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    err = setTo(data, size, false, flags);
+    mMappedData = data;
+    mMappedSize = size;
+    return err;
+}
+
 status_t ResXMLTree::getError() const
 {
     return mError;
 }
 
+void ResXMLTree::setDiagnostics(ResDiagnostics* diag)
+{
+    mDiag = diag;
+    mStrings.setDiagnostics(diag, mHeader);
+}
+
+ResDiagnostics* ResXMLTree::getDiagnostics() const
+{
+    return mDiag;
+}
+
+status_t ResXMLTree::buildIndex()
+{
+    if (mError != NO_ERROR) {
+        return mError;
+    }
+    if (mIndexed) {
+        return NO_ERROR;
+    }
+
+    mEvents.clear();
+    mElements.clear();
+
+    // Open START_TAGs, and the last event seen at each depth so that it can
+    // be linked to its next sibling.
+    std::vector<int32_t> open;
+    std::vector<int32_t> lastAtDepth(1, -1);
+
+    ResXMLParser parser(*this);
+    parser.restart();
+    event_code_t code;
+    while ((code=parser.next()) != END_DOCUMENT && code != BAD_DOCUMENT) {
+        if (mEvents.size() >= INT32_MAX) {
+            mEvents.clear();
+            mElements.clear();
+            return NO_MEMORY;
+        }
+        const int32_t idx = mEvents.size();
+
+        ResXMLEvent event;
+        event.eventCode = code;
+        event.node = parser.mCurNode;
+        event.ext = parser.mCurExt;
+        event.firstChild = -1;
+        event.nextSibling = -1;
+        event.match = -1;
+
+        if (code == END_TAG) {
+            if (!open.empty()) {
+                event.match = open.back();
+                mEvents[event.match].match = idx;
+                open.pop_back();
+                lastAtDepth.pop_back();
+            }
+            event.depth = open.size();
+            event.parent = open.empty() ? -1 : open.back();
+            mEvents.push_back(event);
+            continue;
+        }
+
+        event.depth = open.size();
+        event.parent = open.empty() ? -1 : open.back();
+        int32_t& last = lastAtDepth.back();
+        if (last >= 0) {
+            mEvents[last].nextSibling = idx;
+        } else if (event.parent >= 0) {
+            mEvents[event.parent].firstChild = idx;
+        }
+        last = idx;
+        mEvents.push_back(event);
+
+        if (code == START_TAG) {
+            mElements.push_back(idx);
+            open.push_back(idx);
+            lastAtDepth.push_back(-1);
+        }
+    }
+
+    mEventsEnd = code;
+    mIndexed = true;
+    return NO_ERROR;
+}
+
+bool ResXMLTree::hasIndex() const
+{
+    return mIndexed;
+}
+
+size_t ResXMLTree::getEventCount() const
+{
+    return mEvents.size();
+}
+
+const ResXMLParser::ResXMLEvent* ResXMLTree::getEvent(size_t idx) const
+{
+    return idx < mEvents.size() ? &mEvents[idx] : NULL;
+}
+
+size_t ResXMLTree::getElementCount() const
+{
+    return mElements.size();
+}
+
+ssize_t ResXMLTree::indexOfElement(size_t n) const
+{
+    return n < mElements.size() ? (ssize_t)mElements[n] : BAD_INDEX;
+}
+
+const ResXMLTree::ResIdIndex* ResXMLTree::getResIdIndex() const
+{
+    ResIdIndex* index = mResIdIndex.load(std::memory_order_acquire);
+    if (index != NULL) {
+        return index;
+    }
+
+    index = ResIdIndex::create(mResIds, mNumResIds);
+    if (index == NULL) {
+        ALOGW("No memory trying to allocate resource ID index\n");
+        return NULL;
+    }
+
+    // Parsers on other threads may build the index at the same time; the
+    // first one published wins.
+    ResIdIndex* expected = NULL;
+    if (!mResIdIndex.compare_exchange_strong(expected, index,
+            std::memory_order_acq_rel, std::memory_order_acquire)) {
+        free(index);
+        return expected;
+    }
+    return index;
+}
+
 void ResXMLTree::uninit()
 {
     mError = NO_INIT;
     mStrings.uninit();
+    mValidated = false;
+    mIndexed = false;
+    std::vector<ResXMLEvent>().swap(mEvents);
+    std::vector<uint32_t>().swap(mElements);
+    free(mResIdIndex.exchange(NULL, std::memory_order_relaxed));
     if (mOwnedData) {
         free(mOwnedData);
         mOwnedData = NULL;
     }
+    if (mMappedData) {
+        munmap(mMappedData, mMappedSize);
+        mMappedData = NULL;
+        mMappedSize = 0;
+    }
     restart();
 }
 
@@ -1251,7 +2236,7 @@ status_t ResXMLTree::validateNode(const ResXMLTree_node* node) const
 
     status_t err = validate_chunk(
         &node->header, sizeof(ResXMLTree_node),
-        mDataEnd, "ResXMLTree_node");
+        mDataEnd, "ResXMLTree_node", mDiag, mHeader);
 
     if (err >= NO_ERROR) {
         // Only perform additional validation on START nodes
@@ -1274,10 +2259,14 @@ status_t ResXMLTree::validateNode(const ResXMLTree_node* node) const
             ALOGW("Bad XML block: node attributes use 0x%x bytes, only have 0x%x bytes\n",
                     (unsigned int)(dtohs(attrExt->attributeStart)+attrSize),
                     (unsigned int)(size-headerSize));
+            report(mDiag, ResDiagnostics::ATTRIBUTES_PAST_END, mHeader, node,
+                   eventCode, size-headerSize, dtohs(attrExt->attributeStart)+attrSize);
         }
         else {
             ALOGW("Bad XML start block: node header size 0x%x, size 0x%x\n",
                 (unsigned int)headerSize, (unsigned int)size);
+            report(mDiag, ResDiagnostics::NODE_TOO_SMALL, mHeader, node,
+                   eventCode, headerSize + sizeof(ResXMLTree_attrExt), size);
         }
         return BAD_TYPE;
     }
@@ -1325,6 +2314,520 @@ status_t ResXMLTree::validateNode(const ResXMLTree_node* node) const
 // --------------------------------------------------------------------
 // --------------------------------------------------------------------
 
+struct ResTable::Type
+{
+    Type() : spec(NULL) {}
+
+    const ResTable_typeSpec*            spec;
+    // First definition of each entry across all configurations, or NULL
+    // if no configuration defines it.
+    std::vector<const ResTable_entry*>  entries;
+};
+
+struct ResTable::Package
+{
+    uint32_t                    id;
+    const ResTable_package*     header;
+    size_t                      nameLen;
+    // Type IDs this package's typeStrings start after
+    uint32_t                    typeIdOffset;
+    ResStringPool               typeStrings;
+    ResStringPool               keyStrings;
+    // Indexed by type ID - 1
+    std::vector<Type>           types;
+};
+
+ResTable::ResTable()
+    : mError(NO_INIT), mOwnedData(NULL), mMappedData(NULL), mMappedSize(0)
+    , mHeader(NULL), mSize(0), mDataEnd(NULL)
+{
+    memset(mPackageMap, 0, sizeof(mPackageMap));
+}
+
+ResTable::~ResTable()
+{
+    uninit();
+}
+
+status_t ResTable::setTo(const void* data, size_t size, bool copyData)
+{
+    uninit();
+
+    if (!data || size < sizeof(ResTable_header)) {
+        return (mError=BAD_TYPE);
+    }
+
+    if (copyData) {
+        mOwnedData = malloc(size);
+        if (mOwnedData == NULL) {
+            return (mError=NO_MEMORY);
+        }
+        memcpy(mOwnedData, data, size);
+        data = mOwnedData;
+    }
+
+    mHeader = (const ResTable_header*)data;
+    mSize = dtohl(mHeader->header.size);
+    if (dtohs(mHeader->header.type) != RES_TABLE_TYPE) {
+        ALOGW("Bad resource table: chunk type 0x%x is not a table\n",
+             (int)dtohs(mHeader->header.type));
+        return (mError=BAD_TYPE);
+    }
+    if (dtohs(mHeader->header.headerSize) > mSize || mSize > size) {
+        ALOGW("Bad resource table: header size %d or total size %d is larger than data size %d\n",
+             (int)dtohs(mHeader->header.headerSize),
+             (int)dtohl(mHeader->header.size), (int)size);
+        return (mError=BAD_TYPE);
+    }
+    mDataEnd = ((const uint8_t*)mHeader) + mSize;
+
+    status_t err = validate_chunk(&mHeader->header, sizeof(ResTable_header),
+                                  mDataEnd, "ResTable");
+    if (err != NO_ERROR) {
+        return (mError=err);
+    }
+
+    const ResChunk_header* chunk = (const ResChunk_header*)
+        (((const uint8_t*)mHeader) + dtohs(mHeader->header.headerSize));
+    while ((size_t)(mDataEnd-((const uint8_t*)chunk)) >= sizeof(ResChunk_header)) {
+        err = validate_chunk(chunk, sizeof(ResChunk_header), mDataEnd, "ResTable chunk");
+        if (err != NO_ERROR) {
+            return (mError=err);
+        }
+        const uint16_t type = dtohs(chunk->type);
+        const size_t csize = dtohl(chunk->size);
+        if (type == RES_STRING_POOL_TYPE) {
+            if (mStrings.getError() == NO_INIT) {
+                err = mStrings.setTo(chunk, csize);
+                if (err != NO_ERROR) {
+                    return (mError=err);
+                }
+            } else {
+                ALOGW("Multiple string chunks found in resource table.\n");
+            }
+        } else if (type == RES_TABLE_PACKAGE_TYPE) {
+            err = parsePackage((const ResTable_package*)chunk);
+            if (err != NO_ERROR) {
+                return (mError=err);
+            }
+        } else {
+            ALOGW("Unknown chunk type 0x%x in table at %p.\n",
+                 (int)type, (void*)(((const uint8_t*)chunk)-((const uint8_t*)mHeader)));
+        }
+        chunk = (const ResChunk_header*)(((const uint8_t*)chunk) + csize);
+    }
+
+    if (mStrings.getError() != NO_ERROR) {
+        ALOGW("No string values found in resource table!\n");
+        return (mError=BAD_TYPE);
+    }
+    if (mPackages.size() != dtohl(mHeader->packageCount)) {
+        ALOGW("Resource table claims %d packages, but %d were found.\n",
+             (int)dtohl(mHeader->packageCount), (int)mPackages.size());
+    }
+
+    return (mError=NO_ERROR);
+}
+
+status_t ResTable::parsePackage(const ResTable_package* pkg)
+{
+    const uint8_t* const base = (const uint8_t*)pkg;
+
+    // Tables from before Lollipop have no typeIdOffset.
+    status_t err = validate_chunk(&pkg->header,
+                                  offsetof(ResTable_package, typeIdOffset),
+                                  mDataEnd, "ResTable_package");
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    const size_t headerSize = dtohs(pkg->header.headerSize);
+    const size_t pkgSize = dtohl(pkg->header.size);
+    const uint8_t* const pkgEnd = base + pkgSize;
+    const uint32_t id = dtohl(pkg->id);
+
+    if (id > 0xff) {
+        ALOGW("Bad package id 0x%x.\n", id);
+        return BAD_TYPE;
+    }
+    if (mPackageMap[id] != NULL) {
+        ALOGW("Ignoring duplicate package with id 0x%02x.\n", id);
+        return NO_ERROR;
+    }
+
+    std::unique_ptr<Package> package(new Package());
+    package->id = id;
+    package->header = pkg;
+    package->nameLen = strnlen16((const char16_t*)pkg->name,
+                                 sizeof(pkg->name)/sizeof(pkg->name[0]));
+    package->typeIdOffset = headerSize >= sizeof(ResTable_package)
+            ? dtohl(pkg->typeIdOffset) : 0;
+    if (package->typeIdOffset > 0xff) {
+        ALOGW("Bad package typeIdOffset 0x%x.\n", package->typeIdOffset);
+        return BAD_TYPE;
+    }
+
+    const uint32_t offsets[] = { dtohl(pkg->typeStrings), dtohl(pkg->keyStrings) };
+    ResStringPool* const pools[] = { &package->typeStrings, &package->keyStrings };
+    for (size_t i = 0; i < 2; i++) {
+        const ResChunk_header* chunk = (const ResChunk_header*)(base + offsets[i]);
+        if (offsets[i] < headerSize || offsets[i] > pkgSize - sizeof(ResStringPool_header)
+                || (offsets[i]&0x3) != 0) {
+            ALOGW("ResTable_package %s strings at 0x%x are outside of the package.\n",
+                 i == 0 ? "type" : "key", offsets[i]);
+            return BAD_TYPE;
+        }
+        err = validate_chunk(chunk, sizeof(ResStringPool_header), pkgEnd,
+                             "ResTable_package strings");
+        if (err == NO_ERROR && dtohs(chunk->type) != RES_STRING_POOL_TYPE) {
+            err = BAD_TYPE;
+        }
+        if (err == NO_ERROR) {
+            err = pools[i]->setTo(chunk, dtohl(chunk->size));
+        }
+        if (err != NO_ERROR) {
+            return err;
+        }
+    }
+
+    const ResChunk_header* chunk = (const ResChunk_header*)(base + headerSize);
+    while ((size_t)(pkgEnd-((const uint8_t*)chunk)) >= sizeof(ResChunk_header)) {
+        err = validate_chunk(chunk, sizeof(ResChunk_header), pkgEnd,
+                             "ResTable_package chunk");
+        if (err != NO_ERROR) {
+            return err;
+        }
+        const uint16_t ctype = dtohs(chunk->type);
+        const size_t csize = dtohl(chunk->size);
+
+        if (ctype == RES_STRING_POOL_TYPE) {
+            // The type and key strings, already handled above.
+        } else if (ctype == RES_TABLE_TYPE_SPEC_TYPE) {
+            const ResTable_typeSpec* spec = (const ResTable_typeSpec*)chunk;
+            err = validate_chunk(chunk, sizeof(ResTable_typeSpec), pkgEnd,
+                                 "ResTable_typeSpec");
+            if (err != NO_ERROR) {
+                return err;
+            }
+            const size_t entryCount = dtohl(spec->entryCount);
+            if (spec->id <= package->typeIdOffset) {
+                ALOGW("ResTable_typeSpec has an id of %d (type ID offset %d).\n",
+                     (int)spec->id, (int)package->typeIdOffset);
+                return BAD_TYPE;
+            }
+            if ((uint64_t)entryCount*sizeof(uint32_t)
+                    > csize - dtohs(spec->header.headerSize)) {
+                ALOGW("ResTable_typeSpec entry index to %p extends beyond chunk end %p.\n",
+                     (void*)(dtohs(spec->header.headerSize)+(sizeof(uint32_t)*entryCount)),
+                     (void*)csize);
+                return BAD_TYPE;
+            }
+            if (package->types.size() < spec->id) {
+                package->types.resize(spec->id);
+            }
+            Type& t = package->types[spec->id-1];
+            if (t.spec == NULL) {
+                t.spec = spec;
+            }
+            if (t.entries.size() < entryCount) {
+                t.entries.resize(entryCount, NULL);
+            }
+        } else if (ctype == RES_TABLE_TYPE_TYPE) {
+            err = parseType(package.get(), (const ResTable_type*)chunk, pkgEnd);
+            if (err != NO_ERROR) {
+                return err;
+            }
+        } else if (ctype == RES_TABLE_LIBRARY_TYPE) {
+            const ResTable_lib_header* lib = (const ResTable_lib_header*)chunk;
+            err = validate_chunk(chunk, sizeof(ResTable_lib_header), pkgEnd,
+                                 "ResTable_lib_header");
+            if (err == NO_ERROR && (uint64_t)dtohl(lib->count)*sizeof(ResTable_lib_entry)
+                    > csize - dtohs(lib->header.headerSize)) {
+                ALOGW("ResTable_lib_header entries extend beyond chunk end.\n");
+                err = BAD_TYPE;
+            }
+            if (err != NO_ERROR) {
+                return err;
+            }
+        } else {
+            ALOGW("Unknown chunk type 0x%x in package at %p.\n",
+                 (int)ctype, (void*)(((const uint8_t*)chunk)-((const uint8_t*)mHeader)));
+        }
+
+        chunk = (const ResChunk_header*)(((const uint8_t*)chunk) + csize);
+    }
+
+    mPackageMap[id] = package.get();
+    mPackages.push_back(std::move(package));
+    return NO_ERROR;
+}
+
+status_t ResTable::parseType(Package* package, const ResTable_type* type,
+                             const uint8_t* dataEnd)
+{
+    // Older tables have a smaller ResTable_config; only its size field is
+    // required.
+    status_t err = validate_chunk(&type->header,
+                                  offsetof(ResTable_type, config) + sizeof(uint32_t),
+                                  dataEnd, "ResTable_type");
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    const size_t headerSize = dtohs(type->header.headerSize);
+    const size_t typeSize = dtohl(type->header.size);
+    const size_t entryCount = dtohl(type->entryCount);
+    const size_t entriesStart = dtohl(type->entriesStart);
+
+    if (type->id <= package->typeIdOffset) {
+        ALOGW("ResTable_type has an id of %d (type ID offset %d).\n",
+             (int)type->id, (int)package->typeIdOffset);
+        return BAD_TYPE;
+    }
+    const bool sparse = (type->flags&ResTable_type::FLAG_SPARSE) != 0;
+    // Other configurations of the type may still be readable, so only this
+    // chunk is skipped.
+    if ((type->flags&~ResTable_type::FLAG_SPARSE) != 0) {
+        ALOGW("Skipping ResTable_type 0x%x with unsupported flags 0x%x.\n",
+             (int)type->id, (int)type->flags);
+        return NO_ERROR;
+    }
+    if (headerSize + (uint64_t)entryCount*sizeof(uint32_t) > typeSize) {
+        ALOGW("ResTable_type entry index to %p extends beyond chunk end 0x%x.\n",
+             (void*)(headerSize + (sizeof(uint32_t)*entryCount)), (int)typeSize);
+        return BAD_TYPE;
+    }
+    if ((entriesStart&0x3) != 0 || entriesStart > typeSize) {
+        ALOGW("ResTable_type entriesStart at 0x%x is bad (type size 0x%x).\n",
+             (int)entriesStart, (int)typeSize);
+        return BAD_TYPE;
+    }
+
+    if (package->types.size() < type->id) {
+        package->types.resize(type->id);
+    }
+    Type& t = package->types[type->id-1];
+    if (!sparse && t.entries.size() < entryCount) {
+        t.entries.resize(entryCount, NULL);
+    }
+
+    const uint8_t* const base = (const uint8_t*)type;
+    const uint32_t* const offsets = (const uint32_t*)(base + headerSize);
+    const ResTable_sparseTypeEntry* const sparseEntries =
+        (const ResTable_sparseTypeEntry*)(base + headerSize);
+    const size_t entriesSize = typeSize - entriesStart;
+    const size_t numKeys = package->keyStrings.size();
+
+    for (size_t n = 0; n < entryCount; n++) {
+        size_t i;
+        uint32_t offset;
+        if (sparse) {
+            i = dtohs(sparseEntries[n].idx);
+            offset = (uint32_t)dtohs(sparseEntries[n].offset) * 4;
+            if (t.entries.size() <= i) {
+                t.entries.resize(i + 1, NULL);
+            }
+        } else {
+            i = n;
+            offset = dtohl(offsets[n]);
+            if (offset == ResTable_type::NO_ENTRY) {
+                continue;
+            }
+        }
+        // Earlier configurations win; the later ones are never looked at.
+        if (t.entries[i] != NULL) {
+            continue;
+        }
+
+        if ((offset&0x3) != 0 || entriesSize < sizeof(ResTable_entry)
+                || offset > entriesSize - sizeof(ResTable_entry)) {
+            ALOGW("ResTable_entry at 0x%x of type 0x%x is beyond type chunk data 0x%x.\n",
+                 offset, (int)type->id, (int)entriesSize);
+            continue;
+        }
+        const ResTable_entry* entry =
+            (const ResTable_entry*)(base + entriesStart + offset);
+        const size_t avail = entriesSize - offset;
+        const size_t entrySize = dtohs(entry->size);
+        if (entrySize < sizeof(ResTable_entry) || entrySize > avail) {
+            ALOGW("ResTable_entry size 0x%x at 0x%x is bad.\n",
+                 (int)entrySize, offset);
+            continue;
+        }
+        if (dtohs(entry->flags)&ResTable_entry::FLAG_COMPLEX) {
+            const ResTable_map_entry* map = (const ResTable_map_entry*)entry;
+            if (entrySize < sizeof(ResTable_map_entry)
+                    || (uint64_t)dtohl(map->count)*sizeof(ResTable_map)
+                        > avail - entrySize) {
+                ALOGW("ResTable_map_entry at 0x%x has bad count.\n", offset);
+                continue;
+            }
+        } else if (avail - entrySize < sizeof(Res_value)) {
+            ALOGW("Res_value at 0x%x is beyond type chunk data.\n",
+                 (int)(offset + entrySize));
+            continue;
+        }
+        if (dtohl(entry->key.index) >= numKeys) {
+            ALOGW("ResTable_entry at 0x%x has bad key index %d.\n",
+                 offset, (int)dtohl(entry->key.index));
+            continue;
+        }
+
+        t.entries[i] = entry;
+    }
+
+    return NO_ERROR;
+}
+
+status_t ResTable::setToFile(const char* path)
+{
+    uninit();
+
+    void* data = NULL;
+    size_t size = 0;
+    status_t err = map_file(path, &data, &size);
+    if (err != NO_ERROR) {
+        return (mError=err);
+    }
+
+    err = setTo(data, size, false);
+    mMappedData = data;
+    mMappedSize = size;
+    return err;
+}
+
+status_t ResTable::getError() const
+{
+    return mError;
+}
+
+void ResTable::uninit()
+{
+    mError = NO_INIT;
+    mPackages.clear();
+    memset(mPackageMap, 0, sizeof(mPackageMap));
+    mStrings.uninit();
+    if (mOwnedData) {
+        free(mOwnedData);
+        mOwnedData = NULL;
+    }
+    if (mMappedData) {
+        munmap(mMappedData, mMappedSize);
+        mMappedData = NULL;
+        mMappedSize = 0;
+    }
+    mHeader = NULL;
+    mSize = 0;
+    mDataEnd = NULL;
+}
+
+const ResTable_entry* ResTable::getEntry(uint32_t resID,
+                                         const Package** outPackage) const
+{
+    const Package* package = mPackageMap[resID>>24];
+    const size_t typeIdx = ((resID>>16)&0xff) - 1;
+    const size_t entryIdx = resID&0xffff;
+
+    // typeIdx wraps around for a type ID of 0
+    if (package == NULL || typeIdx >= package->types.size()) {
+        return NULL;
+    }
+    const Type& t = package->types[typeIdx];
+    if (entryIdx >= t.entries.size()) {
+        return NULL;
+    }
+    *outPackage = package;
+    return t.entries[entryIdx];
+}
+
+bool ResTable::getResourceName(uint32_t resID, bool allowUtf8,
+                               resource_name* outName) const
+{
+    const Package* package;
+    const ResTable_entry* entry = getEntry(resID, &package);
+    if (entry == NULL) {
+        return false;
+    }
+
+    // getEntry() only finds types above typeIdOffset
+    const size_t typeIdx = ((resID>>16)&0xff) - 1 - package->typeIdOffset;
+    const size_t keyIdx = dtohl(entry->key.index);
+
+    outName->package = (const char16_t*)package->header->name;
+    outName->packageLen = package->nameLen;
+    outName->type8 = NULL;
+    outName->type = NULL;
+    outName->name8 = NULL;
+    outName->name = NULL;
+    if (allowUtf8) {
+        outName->type8 = package->typeStrings.string8At(typeIdx, &outName->typeLen);
+        outName->name8 = package->keyStrings.string8At(keyIdx, &outName->nameLen);
+    }
+    if (outName->type8 == NULL) {
+        outName->type = package->typeStrings.stringAt(typeIdx, &outName->typeLen);
+        if (outName->type == NULL) {
+            return false;
+        }
+    }
+    if (outName->name8 == NULL) {
+        outName->name = package->keyStrings.stringAt(keyIdx, &outName->nameLen);
+        if (outName->name == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+status_t ResTable::getResource(uint32_t resID, Res_value* outValue) const
+{
+    const Package* package;
+    const ResTable_entry* entry = getEntry(resID, &package);
+    if (entry == NULL) {
+        return BAD_INDEX;
+    }
+    if (dtohs(entry->flags)&ResTable_entry::FLAG_COMPLEX) {
+        return BAD_VALUE;
+    }
+    const Res_value* value = (const Res_value*)
+        (((const uint8_t*)entry) + dtohs(entry->size));
+    outValue->copyFrom_dtoh(*value);
+    return NO_ERROR;
+}
+
+const ResStringPool* ResTable::getTableStringBlock() const
+{
+    return &mStrings;
+}
+
+size_t ResTable::getPackageCount() const
+{
+    return mPackages.size();
+}
+
+uint32_t ResTable::getPackageId(size_t idx) const
+{
+    return idx < mPackages.size() ? mPackages[idx]->id : 0;
+}
+
+size_t ResTable::getTypeCount(uint32_t packageId) const
+{
+    const Package* package = packageId <= 0xff ? mPackageMap[packageId] : NULL;
+    return package != NULL ? package->types.size() : 0;
+}
+
+size_t ResTable::getEntryCount(uint32_t packageId, uint32_t typeId) const
+{
+    const Package* package = packageId <= 0xff ? mPackageMap[packageId] : NULL;
+    if (package == NULL || typeId == 0 || typeId > package->types.size()) {
+        return 0;
+    }
+    return package->types[typeId-1].entries.size();
+}
+
+// --------------------------------------------------------------------
+// --------------------------------------------------------------------
+// --------------------------------------------------------------------
+
 StringPoolRef::StringPoolRef(const ResStringPool* pool, uint32_t index)
     : mPool(pool), mIndex(index) {}
 
@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ZipFileRO"
+
+#include <logging.h>
+
+#include <androidfw/ZipFileRO.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+namespace android {
+
+// End of central directory record
+static const uint32_t kEOCDSignature = 0x06054b50;
+static const size_t kEOCDLen = 22;
+static const size_t kEOCDNumEntries = 10;
+static const size_t kEOCDSize = 12;
+static const size_t kEOCDFileOffset = 16;
+static const size_t kMaxCommentLen = 65535;
+
+// Central directory file header
+static const uint32_t kCDESignature = 0x02014b50;
+static const size_t kCDELen = 46;
+static const size_t kCDEGPBFlags = 8;
+static const size_t kCDEMethod = 10;
+static const size_t kCDECRC = 16;
+static const size_t kCDECompLen = 20;
+static const size_t kCDEUncompLen = 24;
+static const size_t kCDENameLen = 28;
+static const size_t kCDEExtraLen = 30;
+static const size_t kCDECommentLen = 32;
+static const size_t kCDELocalOffset = 42;
+
+// Local file header
+static const uint32_t kLFHSignature = 0x04034b50;
+static const size_t kLFHLen = 30;
+static const size_t kLFHNameLen = 26;
+static const size_t kLFHExtraLen = 28;
+
+static const uint16_t kGPBFEncrypted = 0x0001;
+
+// Deflate cannot do better than about 1032:1, so anything claiming more is
+// corrupt (or a decompression bomb).
+static const uint64_t kMaxDeflateRatio = 1032;
+
+static inline uint16_t get2LE(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get4LE(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+ZipFileRO::ZipFileRO()
+    : mData(NULL), mSize(0)
+{
+}
+
+ZipFileRO::~ZipFileRO()
+{
+    close();
+}
+
+status_t ZipFileRO::open(const char* path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) {
+        const status_t err = -errno;
+        ::close(fd);
+        return err;
+    }
+    if (S_ISDIR(sb.st_mode)) {
+        ::close(fd);
+        return -EISDIR;
+    }
+    if (sb.st_size < (off_t) kEOCDLen) {
+        ::close(fd);
+        return BAD_TYPE;
+    }
+
+    void* data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    const status_t mapErr = -errno;
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return mapErr;
+    }
+
+    mData = data;
+    mSize = sb.st_size;
+
+    status_t err = parseCentralDirectory();
+    if (err != NO_ERROR) {
+        close();
+    }
+    return err;
+}
+
+void ZipFileRO::close()
+{
+    if (mData) {
+        munmap(mData, mSize);
+        mData = NULL;
+        mSize = 0;
+    }
+    mEntries.clear();
+}
+
+status_t ZipFileRO::parseCentralDirectory()
+{
+    const uint8_t* const base = (const uint8_t*) mData;
+
+    // The end of central directory record is followed only by the archive
+    // comment, so search backwards for it.
+    const size_t searchLen = mSize < kEOCDLen + kMaxCommentLen
+            ? mSize : kEOCDLen + kMaxCommentLen;
+    const uint8_t* eocd = NULL;
+    for (size_t i = kEOCDLen; i <= searchLen; ++i) {
+        if (get4LE(base + mSize - i) == kEOCDSignature) {
+            eocd = base + mSize - i;
+            break;
+        }
+    }
+    if (eocd == NULL) {
+        ALOGW("Bad ZIP archive: end of central directory not found\n");
+        return BAD_TYPE;
+    }
+
+    const size_t numEntries = get2LE(eocd + kEOCDNumEntries);
+    const uint32_t cdSize = get4LE(eocd + kEOCDSize);
+    const uint32_t cdOffset = get4LE(eocd + kEOCDFileOffset);
+
+    if (numEntries == 0xffff || cdSize == 0xffffffff
+            || cdOffset == 0xffffffff) {
+        ALOGW("ZIP64 archives are not supported\n");
+        return BAD_TYPE;
+    }
+    if (cdOffset > (size_t) (eocd - base)
+            || cdSize > (size_t) (eocd - base) - cdOffset) {
+        ALOGW("Bad ZIP archive: central directory (offset %u, size %u) "
+              "extends past end of central directory record at %zu\n",
+              cdOffset, cdSize, (size_t) (eocd - base));
+        return BAD_TYPE;
+    }
+
+    mEntries.reserve(numEntries);
+
+    const uint8_t* p = base + cdOffset;
+    const uint8_t* const cdEnd = p + cdSize;
+    for (size_t i = 0; i < numEntries; ++i) {
+        if ((size_t) (cdEnd - p) < kCDELen || get4LE(p) != kCDESignature) {
+            ALOGW("Bad ZIP archive: missing central directory entry #%zu\n", i);
+            return BAD_TYPE;
+        }
+
+        const size_t nameLen = get2LE(p + kCDENameLen);
+        const size_t entryLen = kCDELen + nameLen + get2LE(p + kCDEExtraLen)
+                + get2LE(p + kCDECommentLen);
+        if (entryLen > (size_t) (cdEnd - p)) {
+            ALOGW("Bad ZIP archive: central directory entry #%zu extends "
+                  "past end of central directory\n", i);
+            return BAD_TYPE;
+        }
+
+        Entry entry;
+        entry.name = (const char*) p + kCDELen;
+        entry.nameLength = nameLen;
+        entry.method = get2LE(p + kCDEMethod);
+        entry.crc32 = get4LE(p + kCDECRC);
+        entry.compressedSize = get4LE(p + kCDECompLen);
+        entry.uncompressedSize = get4LE(p + kCDEUncompLen);
+        entry.localHeaderOffset = get4LE(p + kCDELocalOffset);
+
+        // Checked when the data is requested so that one bad entry does not
+        // make the whole archive unreadable
+        if (get2LE(p + kCDEGPBFlags) & kGPBFEncrypted) {
+            entry.method = 0xffff;
+        }
+
+        mEntries.push_back(entry);
+        p += entryLen;
+    }
+
+    return NO_ERROR;
+}
+
+size_t ZipFileRO::getNumEntries() const
+{
+    return mEntries.size();
+}
+
+const ZipFileRO::Entry* ZipFileRO::getEntry(size_t idx) const
+{
+    return idx < mEntries.size() ? &mEntries[idx] : NULL;
+}
+
+ssize_t ZipFileRO::findEntry(const char* name) const
+{
+    const size_t len = strlen(name);
+    for (size_t i = 0; i < mEntries.size(); ++i) {
+        const Entry& entry = mEntries[i];
+        if (entry.nameLength == len && memcmp(entry.name, name, len) == 0) {
+            return i;
+        }
+    }
+    return NAME_NOT_FOUND;
+}
+
+status_t ZipFileRO::getEntryData(size_t idx, std::vector<uint8_t>* buffer,
+                                 const void** outData, size_t* outSize) const
+{
+    if (idx >= mEntries.size()) {
+        return BAD_INDEX;
+    }
+
+    const Entry& entry = mEntries[idx];
+    const uint8_t* const base = (const uint8_t*) mData;
+
+    // The local header's name and extra field lengths may differ from the
+    // central directory's, so the data offset has to come from here.
+    if (entry.localHeaderOffset > mSize
+            || mSize - entry.localHeaderOffset < kLFHLen
+            || get4LE(base + entry.localHeaderOffset) != kLFHSignature) {
+        ALOGW("Bad ZIP entry %.*s: invalid local header offset %u\n",
+              (int) entry.nameLength, entry.name, entry.localHeaderOffset);
+        return BAD_TYPE;
+    }
+    const uint8_t* lfh = base + entry.localHeaderOffset;
+    const size_t dataOffset = entry.localHeaderOffset + kLFHLen
+            + get2LE(lfh + kLFHNameLen) + get2LE(lfh + kLFHExtraLen);
+    if (dataOffset > mSize || mSize - dataOffset < entry.compressedSize) {
+        ALOGW("Bad ZIP entry %.*s: data (offset %zu, size %u) extends past "
+              "end of archive\n", (int) entry.nameLength, entry.name,
+              dataOffset, entry.compressedSize);
+        return BAD_TYPE;
+    }
+    const uint8_t* data = base + dataOffset;
+
+    if (entry.method == kCompressStored) {
+        if (entry.compressedSize != entry.uncompressedSize) {
+            ALOGW("Bad ZIP entry %.*s: stored entry has compressed size %u "
+                  "but uncompressed size %u\n", (int) entry.nameLength,
+                  entry.name, entry.compressedSize, entry.uncompressedSize);
+            return BAD_TYPE;
+        }
+        *outData = data;
+        *outSize = entry.uncompressedSize;
+        return NO_ERROR;
+    } else if (entry.method != kCompressDeflated) {
+        ALOGW("Unsupported compression method %u for ZIP entry %.*s\n",
+              entry.method, (int) entry.nameLength, entry.name);
+        return BAD_TYPE;
+    }
+
+    if (entry.uncompressedSize
+            > (uint64_t) entry.compressedSize * kMaxDeflateRatio + 1024) {
+        ALOGW("Bad ZIP entry %.*s: implausible uncompressed size %u for "
+              "compressed size %u\n", (int) entry.nameLength, entry.name,
+              entry.uncompressedSize, entry.compressedSize);
+        return BAD_TYPE;
+    }
+
+    // zlib rejects a NULL output pointer even when there is nothing to write,
+    // so an empty entry still needs a byte of buffer
+    if (buffer->size() < entry.uncompressedSize || buffer->empty()) {
+        buffer->resize(entry.uncompressedSize > 0 ? entry.uncompressedSize : 1);
+    }
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // Negative window bits: raw deflate data without a zlib header
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+        return NO_MEMORY;
+    }
+    zs.next_in = const_cast<Bytef*>(data);
+    zs.avail_in = entry.compressedSize;
+    zs.next_out = buffer->data();
+    zs.avail_out = entry.uncompressedSize;
+
+    const int zerr = inflate(&zs, Z_FINISH);
+    const uLong produced = zs.total_out;
+    inflateEnd(&zs);
+
+    if (zerr != Z_STREAM_END || produced != entry.uncompressedSize) {
+        ALOGW("Bad ZIP entry %.*s: inflate failed (zlib error %d, %lu of %u "
+              "bytes)\n", (int) entry.nameLength, entry.name, zerr,
+              produced, entry.uncompressedSize);
+        return BAD_TYPE;
+    }
+    if (crc32(crc32(0, Z_NULL, 0), buffer->data(), produced) != entry.crc32) {
+        ALOGW("Bad ZIP entry %.*s: CRC mismatch\n",
+              (int) entry.nameLength, entry.name);
+        return BAD_TYPE;
+    }
+
+    *outData = buffer->data();
+    *outSize = entry.uncompressedSize;
+    return NO_ERROR;
+}
+
+} // namespace android
@@ -15,258 +15,772 @@
  * limitations under the License.
  */
 
-#include <iostream>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <androidfw/ResourceTypes.h>
+#include <androidfw/ZipFileRO.h>
+
+#include <logging.h>
 
-#include <utils/String8.h>
+#include <utils/ByteOrder.h>
+#include <utils/StringArena.h>
+#include <utils/Timers.h>
 
-#include <pugixml.hpp>
+#include "xml_printer.h"
 
 using namespace android;
 
-struct namespace_entry {
-    String8 prefix;
-    String8 uri;
+struct print_options {
+    bool useDom;
+    const resource_names *names;
+};
+
+struct batch_job {
+    // Path of the file, or "<archive>!/<entry>" for archive entries
+    std::string input;
+    std::string output;
+    size_t size;
+    std::shared_ptr<ZipFileRO> archive;
+    size_t entry;
+};
+
+enum job_result {
+    JOB_FAILED,
+    JOB_SKIPPED,
+    JOB_CONVERTED,
 };
 
-static String8 build_namespace(const std::vector<namespace_entry> &namespaces,
-                               const char16_t *ns)
+// Scratch buffers for reading archive entries, reused by each worker
+struct entry_buffers {
+    std::vector<uint8_t> inflated;
+    std::vector<uint8_t> aligned;
+};
+
+// Returns an archive entry name with empty and "." components removed so that
+// it can be appended to the output directory. ".." components are kept, but
+// renamed so that they cannot leave it.
+static std::string relative_path(const std::string &path)
 {
-    String8 str;
-    if (ns) {
-        str = String8(ns);
-        for (const namespace_entry &ne : namespaces) {
-            if (ne.uri == str) {
-                str = ne.prefix;
-                break;
+    std::string result;
+    size_t start = 0;
+    while (start < path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        const std::string component = path.substr(start, end - start);
+        if (!component.empty() && component != ".") {
+            if (!result.empty()) {
+                result += '/';
             }
+            result += component == ".." ? "__up__" : component;
+        }
+        start = end + 1;
+    }
+    return result;
+}
+
+// Returns the name of the output directory (or file) for a path given on the
+// command line: its last component, with "-2", "-3", etc. added if an
+// earlier path had the same one. used holds the names handed out so far.
+static std::string output_name(const std::string &path,
+                               std::set<std::string> *used)
+{
+    // npos + 1 == 0
+    std::string name = path.substr(0, path.find_last_not_of('/') + 1);
+    name = name.substr(name.rfind('/') + 1);
+    if (name.empty() || name == "." || name == "..") {
+        // Use the name of the directory that it refers to
+        char *real = realpath(path.c_str(), NULL);
+        if (real) {
+            const char *slash = strrchr(real, '/');
+            name = slash ? slash + 1 : real;
+            free(real);
+        }
+        if (name.empty() || name == "." || name == "..") {
+            name = "root";
         }
-        str.append(":");
     }
-    return str;
+
+    // The suffix goes before the extension, if there is one
+    size_t dot = name.rfind('.');
+    if (dot == 0 || dot == std::string::npos) {
+        dot = name.size();
+    }
+    std::string unique = name;
+    for (int n = 2; !used->insert(unique).second; ++n) {
+        unique = name.substr(0, dot) + "-" + std::to_string(n) + name.substr(dot);
+    }
+    return unique;
+}
+
+static bool ends_with(const std::string &str, const char *suffix)
+{
+    const size_t len = strlen(suffix);
+    return str.size() >= len
+            && str.compare(str.size() - len, len, suffix) == 0;
+}
+
+// Checks for the signature of a local file header or of the end of central
+// directory record (empty archive)
+static bool is_archive(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return false;
+    }
+    unsigned char magic[4];
+    const bool ret = fread(magic, 1, sizeof(magic), fp) == sizeof(magic)
+            && magic[0] == 'P' && magic[1] == 'K'
+            && ((magic[2] == 3 && magic[3] == 4)
+                    || (magic[2] == 5 && magic[3] == 6));
+    fclose(fp);
+    return ret;
 }
 
-static String8 complexToString(uint32_t complex, bool isFraction)
+// Adds the entries of an archive. Without a list of entry names, every *.xml
+// entry is a candidate; the ones that are not binary XML are skipped later.
+static bool add_archive(std::vector<batch_job> *jobs, const std::string &path,
+                        const std::string &outdir,
+                        const std::vector<std::string> &entries)
 {
-    const float MANTISSA_MULT =
-            1.0f / (1 << Res_value::COMPLEX_MANTISSA_SHIFT);
-    const float RADIX_MULTS[] = {
-        1.0f * MANTISSA_MULT, 1.0f / (1 << 7) * MANTISSA_MULT,
-        1.0f / (1 << 15) * MANTISSA_MULT, 1.0f / (1 << 23) * MANTISSA_MULT
+    std::shared_ptr<ZipFileRO> zip(new ZipFileRO());
+    status_t err = zip->open(path.c_str());
+    if (err != NO_ERROR) {
+        if (err == BAD_TYPE) {
+            fprintf(stderr, "Error: Archive %s is corrupt\n", path.c_str());
+        } else {
+            fprintf(stderr, "Error: Failed to open %s: %s\n",
+                    path.c_str(), strerror(-err));
+        }
+        return false;
+    }
+
+    const std::string prefix = outdir + "/";
+    bool ret = true;
+
+    auto add_entry = [&](size_t idx) {
+        const ZipFileRO::Entry *entry = zip->getEntry(idx);
+        const std::string name(entry->name, entry->nameLength);
+        jobs->push_back({ path + "!/" + name, prefix + relative_path(name),
+                          entry->uncompressedSize, zip, idx });
     };
 
-    float value = (complex & (Res_value::COMPLEX_MANTISSA_MASK
-                    << Res_value::COMPLEX_MANTISSA_SHIFT))
-            * RADIX_MULTS[(complex >> Res_value::COMPLEX_RADIX_SHIFT)
-                    & Res_value::COMPLEX_RADIX_MASK];
-
-    String8 result = String8::format("%f", value);
-
-    if (!isFraction) {
-        switch ((complex >> Res_value::COMPLEX_UNIT_SHIFT)
-                & Res_value::COMPLEX_UNIT_MASK) {
-        case Res_value::COMPLEX_UNIT_PX: result.append("px"); break;
-        case Res_value::COMPLEX_UNIT_DIP: result.append("dp"); break;
-        case Res_value::COMPLEX_UNIT_SP: result.append("sp"); break;
-        case Res_value::COMPLEX_UNIT_PT: result.append("pt"); break;
-        case Res_value::COMPLEX_UNIT_IN: result.append("in"); break;
-        case Res_value::COMPLEX_UNIT_MM: result.append("mm"); break;
-        default: result.append(" (unknown unit)"); break;
+    if (entries.empty()) {
+        for (size_t i = 0; i < zip->getNumEntries(); ++i) {
+            const ZipFileRO::Entry *entry = zip->getEntry(i);
+            if (ends_with(std::string(entry->name, entry->nameLength), ".xml")) {
+                add_entry(i);
+            }
         }
     } else {
-        switch ((complex >> Res_value::COMPLEX_UNIT_SHIFT)
-                & Res_value::COMPLEX_UNIT_MASK) {
-        case Res_value::COMPLEX_UNIT_FRACTION: result.append("%"); break;
-        case Res_value::COMPLEX_UNIT_FRACTION_PARENT: result.append("%p"); break;
-        default: result.append(" (unknown unit)"); break;
+        for (const std::string &name : entries) {
+            ssize_t idx = zip->findEntry(name.c_str());
+            if (idx < 0) {
+                fprintf(stderr, "Error: Entry %s not found in %s\n",
+                        name.c_str(), path.c_str());
+                ret = false;
+            } else {
+                add_entry(idx);
+            }
         }
     }
 
-    return result;
+    return ret;
 }
 
-void printXML(ResXMLTree *block)
+// Adds every *.xml and *.apk file below dir, which is converted into outdir.
+// Symbolic links are not followed, so a link loop cannot recurse forever.
+static bool add_directory(std::vector<batch_job> *jobs, const std::string &dir,
+                          const std::string &outdir,
+                          const std::vector<std::string> &entries)
 {
-    pugi::xml_document doc;
+    DIR *dp = opendir(dir.c_str());
+    if (!dp) {
+        fprintf(stderr, "Error: Failed to open directory %s: %s\n",
+                dir.c_str(), strerror(errno));
+        return false;
+    }
 
-    std::vector<pugi::xml_node> stack;
+    bool ret = true;
+    struct dirent *ent;
+    while ((ent = readdir(dp))) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
 
-    block->restart();
+        const std::string path = dir + "/" + ent->d_name;
+        const std::string output = outdir + "/" + ent->d_name;
+
+        struct stat sb;
+        if (lstat(path.c_str(), &sb) < 0) {
+            fprintf(stderr, "Error: Failed to stat %s: %s\n",
+                    path.c_str(), strerror(errno));
+            ret = false;
+        } else if (S_ISDIR(sb.st_mode)) {
+            ret = add_directory(jobs, path, output, entries) && ret;
+        } else if (!S_ISREG(sb.st_mode)) {
+            continue;
+        } else if (ends_with(path, ".apk")) {
+            ret = add_archive(jobs, path, output, entries) && ret;
+        } else if (ends_with(path, ".xml")) {
+            jobs->push_back({ path, output, (size_t) sb.st_size, nullptr, 0 });
+        }
+    }
 
-    std::vector<namespace_entry> namespaces;
+    closedir(dp);
+    return ret;
+}
 
-    ResXMLTree::event_code_t code;
-    while ((code = block->next()) != ResXMLTree::END_DOCUMENT
-            && code != ResXMLTree::BAD_DOCUMENT) {
-        if (code == ResXMLTree::START_TAG) {
-            // Get parent node
-            pugi::xml_node &parent = stack.empty() ? doc : stack.back();
+// Adds a path given on the command line. Its output is named after its last
+// component, so that the outputs of different paths do not overlap.
+static bool add_path(std::vector<batch_job> *jobs, const std::string &path,
+                     const std::string &outdir,
+                     const std::vector<std::string> &entries,
+                     std::set<std::string> *used)
+{
+    struct stat sb;
+    if (stat(path.c_str(), &sb) < 0) {
+        fprintf(stderr, "Error: Failed to stat %s: %s\n",
+                path.c_str(), strerror(errno));
+        return false;
+    }
 
-            size_t len;
+    const std::string output = outdir + "/" + output_name(path, used);
 
-            // Get comment (if any)
-            const char16_t *com16 = block->getComment(&len);
-            if (com16) {
-                parent.append_child(pugi::node_comment).set_value(
-                        String8(com16));
-            }
+    if (S_ISDIR(sb.st_mode)) {
+        return add_directory(jobs, path, output, entries);
+    } else if (is_archive(path.c_str())) {
+        return add_archive(jobs, path, output, entries);
+    }
 
-            // Get element name
-            const char16_t *ns16 = block->getElementNamespace(&len);
-            String8 name = build_namespace(namespaces, ns16);
-            name.append(String8(block->getElementName(&len)));
-
-            // Add to stack
-            stack.push_back(parent.append_child(name.string()));
-
-            pugi::xml_node &current = stack.back();
-
-            // Add attributes
-            int numattrs = block->getAttributeCount();
-            for (int i = 0; i < numattrs; ++i) {
-                // Attribute name
-                ns16 = block->getAttributeNamespace(i, &len);
-                name = build_namespace(namespaces, ns16);
-                name.append(String8(block->getAttributeName(i, &len)));
-
-                pugi::xml_attribute attr = current.append_attribute(name);
-
-                // Attribute value
-                Res_value value;
-                block->getAttributeValue(i, &value);
-                if (value.dataType == Res_value::TYPE_NULL) {
-                    // Empty attribute
-                } else if (value.dataType == Res_value::TYPE_REFERENCE
-                        || value.dataType == Res_value::TYPE_DYNAMIC_REFERENCE) {
-                    attr = String8::format("@0x%08x", value.data);
-                } else if (value.dataType == Res_value::TYPE_ATTRIBUTE) {
-                    attr = String8::format("?0x%08x", value.data);
-                } else if (value.dataType == Res_value::TYPE_STRING) {
-                    attr = String8(block->getAttributeStringValue(i, &len));
-                } else if (value.dataType == Res_value::TYPE_FLOAT) {
-                    attr = *(const float *) &value.data;
-                } else if (value.dataType == Res_value::TYPE_DIMENSION) {
-                    attr = complexToString(value.data, false);
-                } else if (value.dataType == Res_value::TYPE_FRACTION) {
-                    attr = complexToString(value.data, true);
-                } else if (value.dataType >= Res_value::TYPE_FIRST_COLOR_INT
-                        && value.dataType <= Res_value::TYPE_LAST_COLOR_INT) {
-                    attr = String8::format("#%08x", value.data);
-                } else if (value.dataType == Res_value::TYPE_INT_BOOLEAN) {
-                    attr = value.data ? "true" : "false";
-                } else if (value.dataType == Res_value::TYPE_INT_DEC) {
-                    attr = value.data;
-                } else if (value.dataType == Res_value::TYPE_INT_HEX) {
-                    attr = String8::format("0x%x", value.data);
-                } else if (value.dataType >= Res_value::TYPE_FIRST_INT
-                        && value.dataType <= Res_value::TYPE_LAST_INT) {
-                    attr = String8::format("0x%x", value.data);
-                } else {
-                    attr = String8::format("(unknown: type=0x%x, value=0x%x)",
-                                           value.dataType, value.data);
-                }
-            }
-        } else if (code == ResXMLTree::END_TAG) {
-            stack.pop_back();
-        } else if (code == ResXMLTree::START_NAMESPACE) {
-            namespace_entry ns;
-            size_t len;
-            const char16_t *prefix16 = block->getNamespacePrefix(&len);
-            if (prefix16) {
-                ns.prefix = String8(prefix16);
-            } else {
-                ns.prefix = "<DEF>";
-            }
-            ns.uri = String8(block->getNamespaceUri(&len));
-
-            namespaces.push_back(ns);
-        } else if (code == ResXMLTree::END_NAMESPACE) {
-            const namespace_entry &ns = namespaces.front();
-            size_t len;
-            const char16_t *prefix16 = block->getNamespacePrefix(&len);
-            String8 pr;
-            if (prefix16) {
-                pr = String8(prefix16);
-            } else {
-                pr = "<DEF>";
+    jobs->push_back({ path, output, (size_t) sb.st_size, nullptr, 0 });
+    return true;
+}
+
+// Reads one path per line from the file at path ("-" for stdin)
+static bool add_list(std::vector<batch_job> *jobs, const char *path,
+                     const std::string &outdir,
+                     const std::vector<std::string> &entries,
+                     std::set<std::string> *used)
+{
+    FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Error: Failed to open %s: %s\n",
+                path, strerror(errno));
+        return false;
+    }
+
+    bool ret = true;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &size, fp)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len > 0) {
+            ret = add_path(jobs, line, outdir, entries, used) && ret;
+        }
+    }
+
+    free(line);
+    if (fp != stdin) {
+        fclose(fp);
+    }
+    return ret;
+}
+
+// Fails if two jobs would write the same output file. Archive entry names
+// are not unique and an entry named "a/b.xml" can clash with one named
+// "a//b.xml" or "/a/b.xml".
+static bool check_outputs(const std::vector<batch_job> &jobs)
+{
+    std::map<std::string, const batch_job *> outputs;
+    bool ret = true;
+    for (const batch_job &job : jobs) {
+        auto it = outputs.insert(std::make_pair(job.output, &job));
+        if (!it.second) {
+            fprintf(stderr, "Error: %s and %s would both be written to %s\n",
+                    it.first->second->input.c_str(), job.input.c_str(),
+                    job.output.c_str());
+            ret = false;
+        }
+    }
+    return ret;
+}
+
+// Creates the parent directories of path
+static bool create_parent_dirs(const std::string &path)
+{
+    size_t pos = 0;
+    while ((pos = path.find('/', pos + 1)) != std::string::npos) {
+        const std::string dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+            fprintf(stderr, "Error: Failed to create directory %s: %s\n",
+                    dir.c_str(), strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+// Prints why the tree's document is corrupt, as far as it is known.
+static void print_corrupt(const ResXMLTree &tree, const char *label,
+                          const char *what)
+{
+    const ResDiagnostics *diag = tree.getDiagnostics();
+    if (!diag || diag->code == ResDiagnostics::NONE) {
+        fprintf(stderr, "%s: Resource %s is corrupt\n", what, label);
+        return;
+    }
+
+    fprintf(stderr, "%s: Resource %s is corrupt: %s (chunk type 0x%04x at"
+            " offset 0x%zx", what, label,
+            ResDiagnostics::codeName(diag->code), diag->chunkType,
+            diag->offset);
+    if (diag->expected != 0 || diag->actual != 0) {
+        fprintf(stderr, ", found 0x%llx, limit 0x%llx",
+                (unsigned long long) diag->actual,
+                (unsigned long long) diag->expected);
+    }
+    fprintf(stderr, ")\n");
+}
+
+static job_result load_file(ResXMLTree *tree, const char *path)
+{
+    status_t err = tree->setToFile(path);
+    if (err == BAD_TYPE) {
+        print_corrupt(*tree, path, "Error");
+        return JOB_FAILED;
+    } else if (err != NO_ERROR) {
+        fprintf(stderr, "Error: Failed to open %s: %s\n",
+                path, strerror(-err));
+        return JOB_FAILED;
+    }
+    return JOB_CONVERTED;
+}
+
+// Parses an archive entry straight from the archive's mapping (stored
+// entries) or from the inflate buffer. Entries that are not binary XML are
+// skipped.
+static job_result load_entry(ResXMLTree *tree, const ZipFileRO &zip,
+                             size_t idx, const char *label,
+                             entry_buffers *buffers)
+{
+    const void *data;
+    size_t size;
+    status_t err = zip.getEntryData(idx, &buffers->inflated, &data, &size);
+    if (err != NO_ERROR) {
+        fprintf(stderr, "Error: Failed to read %s\n", label);
+        return JOB_FAILED;
+    }
+
+    ResChunk_header header;
+    if (size < sizeof(header)) {
+        return JOB_SKIPPED;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (dtohs(header.type) != RES_XML_TYPE) {
+        return JOB_SKIPPED;
+    }
+
+    // Stored entries are not necessarily 4-byte aligned in the archive, but
+    // ResXMLTree accesses the chunks in place
+    if (((uintptr_t) data & 0x3) != 0) {
+        buffers->aligned.assign((const uint8_t *) data,
+                                (const uint8_t *) data + size);
+        data = buffers->aligned.data();
+    }
+
+    err = tree->setTo(data, size);
+    if (err != NO_ERROR) {
+        print_corrupt(*tree, label, "Error");
+        return JOB_FAILED;
+    }
+    return JOB_CONVERTED;
+}
+
+// Loads the resource names from a resources.arsc file or from the
+// resources.arsc entry of an APK.
+static bool load_resource_names(resource_names *names, const char *path)
+{
+    ResTable table;
+    status_t err;
+
+    if (is_archive(path)) {
+        ZipFileRO zip;
+        err = zip.open(path);
+        if (err == NO_ERROR) {
+            ssize_t idx = zip.findEntry("resources.arsc");
+            if (idx < 0) {
+                fprintf(stderr, "Error: Entry resources.arsc not found in %s\n",
+                        path);
+                return false;
             }
-            if (ns.prefix != pr) {
-                fprintf(stderr, "Error: Bad end namespace prefix: found=%s, expected=%s\n",
-                        pr.string(), ns.prefix.string());
+            std::vector<uint8_t> buffer;
+            const void *data;
+            size_t size;
+            err = zip.getEntryData(idx, &buffer, &data, &size);
+            if (err == NO_ERROR) {
+                // Copied because the entry may not be aligned and the
+                // archive is unmapped when it goes out of scope
+                err = table.setTo(data, size, true);
             }
+        }
+    } else {
+        err = table.setToFile(path);
+    }
 
-            String8 uri = String8(block->getNamespaceUri(&len));
-            if (ns.uri != uri) {
-                fprintf(stderr, "Error: Bad end namespace URI: found=%s, expected=%s\n",
-                        uri.string(), ns.uri.string());
-            }
+    if (err == BAD_TYPE) {
+        fprintf(stderr, "Error: Resource table %s is corrupt\n", path);
+        return false;
+    } else if (err != NO_ERROR) {
+        fprintf(stderr, "Error: Failed to open %s: %s\n",
+                path, strerror(-err));
+        return false;
+    }
 
-            // Hackish, but we don't need a full-blown XML library with
-            // namespaces support
-            pugi::xml_node child = doc.first_child();
-            if (child) {
-                String8 attrName("xmlns:");
-                attrName.append(ns.prefix);
-                child.append_attribute(attrName) = ns.uri;
-            }
+    add_resource_names(names, table);
+    return true;
+}
 
-            namespaces.pop_back();
-        } else if (code == ResXMLTree::TEXT) {
-            size_t len;
+static void print_tree(ResXMLTree *tree, const char *label, FILE *out,
+                       const print_options &options, StringArena *arena)
+{
+    tree->restart();
+#ifdef WITH_PUGIXML
+    if (options.useDom) {
+        printXML(tree, out, options.names, arena);
+    } else {
+        streamXML(tree, out, options.names, arena);
+    }
+#else
+    streamXML(tree, out, options.names, arena);
+#endif
+    // The output stops where next() found the document to be corrupt
+    const ResDiagnostics *diag = tree->getDiagnostics();
+    if (diag && diag->code != ResDiagnostics::NONE) {
+        print_corrupt(*tree, label, "Warning");
+    }
+    tree->uninit();
+}
+
+static job_result convert_job(ResXMLTree *tree, const batch_job &job,
+                              entry_buffers *buffers, StringArena *arena,
+                              const print_options &options)
+{
+    // A corrupt file can log the same warning for every string in it
+    LogScope logScope;
 
-            pugi::xml_node &current = stack.empty() ? doc : stack.back();
-            current.append_child(pugi::node_pcdata).set_value(
-                    String8(block->getText(&len)));
+    job_result result;
+    if (job.archive) {
+        result = load_entry(tree, *job.archive, job.entry, job.input.c_str(),
+                            buffers);
+    } else {
+        result = load_file(tree, job.input.c_str());
+    }
+    if (result != JOB_CONVERTED) {
+        return result;
+    }
+
+    FILE *fp = NULL;
+    if (create_parent_dirs(job.output)) {
+        fp = fopen(job.output.c_str(), "wb");
+        if (!fp) {
+            fprintf(stderr, "Error: Failed to open %s for writing: %s\n",
+                    job.output.c_str(), strerror(errno));
+        }
+    }
+    if (!fp) {
+        tree->uninit();
+        return JOB_FAILED;
+    }
+
+    print_tree(tree, job.input.c_str(), fp, options, arena);
+
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Error: Failed to write %s: %s\n",
+                job.output.c_str(), strerror(errno));
+        unlink(job.output.c_str());
+        return JOB_FAILED;
+    }
+    return JOB_CONVERTED;
+}
+
+// Converts all jobs on a fixed pool of worker threads. Each worker has its own
+// ResXMLTree and takes the next unclaimed job until none are left.
+static bool run_batch(const std::vector<batch_job> &jobs, unsigned int threads,
+                      const print_options &options)
+{
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> converted(0);
+    std::atomic<size_t> failed(0);
+    std::atomic<size_t> bytes(0);
+
+    auto worker = [&]() {
+        ResDiagnostics diag;
+        ResXMLTree tree;
+        tree.setDiagnostics(&diag);
+        entry_buffers buffers;
+        StringArena arena;
+        size_t i;
+        while ((i = next.fetch_add(1, std::memory_order_relaxed)) < jobs.size()) {
+            switch (convert_job(&tree, jobs[i], &buffers, &arena, options)) {
+            case JOB_CONVERTED:
+                converted.fetch_add(1, std::memory_order_relaxed);
+                bytes.fetch_add(jobs[i].size, std::memory_order_relaxed);
+                break;
+            case JOB_FAILED:
+                failed.fetch_add(1, std::memory_order_relaxed);
+                break;
+            case JOB_SKIPPED:
+                break;
+            }
         }
+    };
+
+    if (threads > jobs.size()) {
+        threads = jobs.size();
     }
 
-    block->restart();
+    const nsecs_t start = systemTime();
+
+    std::vector<std::thread> pool;
+    for (unsigned int i = 1; i < threads; ++i) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &t : pool) {
+        t.join();
+    }
 
-    doc.print(std::cout);
+    const double seconds = (systemTime() - start) / 1e9;
+
+    fprintf(stderr, "Converted %zu of %zu files with %u threads in %.3f s"
+            " (%.1f files/s, %.2f MB/s)\n",
+            size_t(converted), size_t(converted + failed), threads, seconds,
+            seconds > 0 ? converted / seconds : 0.0,
+            seconds > 0 ? bytes / seconds / (1024 * 1024) : 0.0);
+
+    return failed == 0;
+}
+
+static void usage(FILE *stream)
+{
+    fprintf(stream,
+            "Usage: axml2xml [option...] <file|apk>\n"
+            "       axml2xml [option...] -o <dir> [<file|apk|dir>...]\n"
+            "\n"
+            "With a single input and no output directory, the XML is written to stdout.\n"
+            "For an APK (or any ZIP archive), that is the entry given with -e, or\n"
+            "AndroidManifest.xml by default.\n"
+            "\n"
+            "Otherwise, every path is converted to <dir>/<name>, where <name> is its\n"
+            "last component (with -2, -3, ... added if it is repeated). Directories\n"
+            "are searched for *.xml and *.apk files, without following symbolic links,\n"
+            "and keep their layout. Archives are converted to <dir>/<name>/<entry> for\n"
+            "every binary XML entry (or only the ones given with -e).\n"
+            "\n"
+            "Options:\n"
+            "  -o, --output <dir>   Write converted files below <dir>\n"
+            "  -l, --list <file>    Read paths to convert from <file> (- for stdin)\n"
+            "  -e, --entry <name>   Convert the archive entry <name> (repeatable)\n"
+            "  -r, --resources <file>\n"
+            "                       Print references by name using the resource table\n"
+            "                       <file> (resources.arsc or an APK, repeatable)\n"
+            "  -j, --jobs <n>       Number of worker threads (default: CPU count)\n"
+#ifdef WITH_PUGIXML
+            "  --dom                Build the whole document with pugixml before printing it\n"
+#endif
+            "  -h, --help           Display this help message\n");
 }
 
 int main(int argc, char * const argv[])
 {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: axml2xml [filename]\n");
-        return EXIT_FAILURE;
+    enum {
+        OPT_DOM = 1000,
+    };
+
+    static const char short_options[] = "o:l:e:r:j:h";
+    static struct option long_options[] = {
+        {"output",    required_argument, 0, 'o'},
+        {"list",      required_argument, 0, 'l'},
+        {"entry",     required_argument, 0, 'e'},
+        {"resources", required_argument, 0, 'r'},
+        {"jobs",      required_argument, 0, 'j'},
+        {"dom",       no_argument,       0, OPT_DOM},
+        {"help",      no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    bool useDom = false;
+    const char *outdir = NULL;
+    std::vector<const char *> lists;
+    std::vector<std::string> entries;
+    std::vector<const char *> tables;
+    unsigned int threads = std::thread::hardware_concurrency();
+    int opt;
+    int long_index = 0;
+
+    while ((opt = getopt_long(argc, argv, short_options,
+                              long_options, &long_index)) != -1) {
+        switch (opt) {
+        case 'o':
+            outdir = optarg;
+            break;
+        case 'l':
+            lists.push_back(optarg);
+            break;
+        case 'e':
+            entries.push_back(optarg);
+            break;
+        case 'r':
+            tables.push_back(optarg);
+            break;
+        case 'j': {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || n <= 0) {
+                fprintf(stderr, "Error: Invalid number of jobs: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            threads = n;
+            break;
+        }
+        case OPT_DOM:
+#ifdef WITH_PUGIXML
+            useDom = true;
+            break;
+#else
+            fprintf(stderr, "Error: --dom is not available in this build "
+                    "(built without pugixml)\n");
+            return EXIT_FAILURE;
+#endif
+        case 'h':
+            usage(stdout);
+            return EXIT_SUCCESS;
+        default:
+            usage(stderr);
+            return EXIT_FAILURE;
+        }
     }
 
-    ResXMLTree tree;
+    if (threads == 0) {
+        threads = 1;
+    }
 
-    FILE *fp = fopen(argv[1], "rb");
-    if (!fp) {
-        fprintf(stderr, "Error: Failed to open %s: %s",
-                argv[1], strerror(errno));
-        return EXIT_FAILURE;
+    resource_names names;
+    for (const char *table : tables) {
+        if (!load_resource_names(&names, table)) {
+            return EXIT_FAILURE;
+        }
     }
 
-    fseek(fp, 0, SEEK_END);
-    off_t size = ftello(fp);
-    rewind(fp);
-    std::vector<unsigned char> buf(size);
-    fread(buf.data(), buf.size(), 1, fp);
-    fclose(fp);
+    print_options options;
+    options.useDom = useDom;
+    options.names = tables.empty() ? NULL : &names;
+
+    if (!outdir) {
+        if (argc - optind != 1 || !lists.empty()) {
+            usage(stderr);
+            return EXIT_FAILURE;
+        }
+
+        const char *path = argv[optind];
+        LogScope logScope;
+        ResDiagnostics diag;
+        ResXMLTree tree;
+        tree.setDiagnostics(&diag);
+        StringArena arena;
+        job_result result;
+
+        if (is_archive(path)) {
+            if (entries.size() > 1) {
+                fprintf(stderr, "Error: Only one entry can be written to stdout\n");
+                return EXIT_FAILURE;
+            }
+            const std::string name = entries.empty()
+                    ? "AndroidManifest.xml" : entries[0];
+            const std::string label = std::string(path) + "!/" + name;
+
+            ZipFileRO zip;
+            entry_buffers buffers;
+            status_t err = zip.open(path);
+            if (err == BAD_TYPE) {
+                fprintf(stderr, "Error: Archive %s is corrupt\n", path);
+                return EXIT_FAILURE;
+            } else if (err != NO_ERROR) {
+                fprintf(stderr, "Error: Failed to open %s: %s\n",
+                        path, strerror(-err));
+                return EXIT_FAILURE;
+            }
+
+            ssize_t idx = zip.findEntry(name.c_str());
+            if (idx < 0) {
+                fprintf(stderr, "Error: Entry %s not found in %s\n",
+                        name.c_str(), path);
+                return EXIT_FAILURE;
+            }
+
+            result = load_entry(&tree, zip, idx, label.c_str(), &buffers);
+            if (result == JOB_SKIPPED) {
+                fprintf(stderr, "Error: %s is not a binary XML file\n",
+                        label.c_str());
+            }
+            if (result == JOB_CONVERTED) {
+                print_tree(&tree, label.c_str(), stdout, options, &arena);
+            }
+        } else {
+            if (!entries.empty()) {
+                fprintf(stderr, "Error: %s is not an archive\n", path);
+                return EXIT_FAILURE;
+            }
+            result = load_file(&tree, path);
+            if (result == JOB_CONVERTED) {
+                print_tree(&tree, path, stdout, options, &arena);
+            }
+        }
+
+        return result == JOB_CONVERTED ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     bool ret = true;
+    std::vector<batch_job> jobs;
+    std::set<std::string> used;
 
-    if (tree.setTo(buf.data(), buf.size()) != NO_ERROR) {
-        fprintf(stderr, "Error: Resource %s is corrupt\n", argv[1]);
-        ret = false;
+    for (const char *list : lists) {
+        ret = add_list(&jobs, list, outdir, entries, &used) && ret;
+    }
+    for (int i = optind; i < argc; ++i) {
+        ret = add_path(&jobs, argv[i], outdir, entries, &used) && ret;
     }
 
-    if (ret) {
-        tree.restart();
-        printXML(&tree);
+    if (jobs.empty()) {
+        fprintf(stderr, "Error: No files to convert\n");
+        return EXIT_FAILURE;
+    }
+    if (!check_outputs(jobs)) {
+        return EXIT_FAILURE;
     }
 
-    tree.uninit();
+    ret = run_batch(jobs, threads, options) && ret;
 
     return ret ? EXIT_SUCCESS : EXIT_FAILURE;
 }
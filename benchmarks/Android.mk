@@ -0,0 +1,45 @@
+# Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+ifneq ($(SKIP_BENCHMARKS),true)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := utf_bench
+LOCAL_SRC_FILES := utf_bench.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../include
+LOCAL_STATIC_LIBRARIES := libaxmlparser libutils
+LOCAL_LDFLAGS := -static
+include $(BUILD_EXECUTABLE)
+
+# Needs the printer (and pugixml) from the examples
+ifneq ($(SKIP_EXAMPLES),true)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := parse_bench
+LOCAL_SRC_FILES := parse_bench.cpp ../xml_printer.cpp
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/.. \
+	$(LOCAL_PATH)/../include \
+	$(LOCAL_PATH)/../external/pugixml/src
+LOCAL_STATIC_LIBRARIES := libaxmlparser libutils libpugixml
+LOCAL_CFLAGS := -DWITH_PUGIXML
+# Heap allocations are counted by wrapping the allocator
+LOCAL_LDFLAGS := -static -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+include $(BUILD_EXECUTABLE)
+
+endif
+
+endif
@@ -0,0 +1,560 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark for the binary XML and resource table parsers. Every binary XML
+// and resources.arsc file given on the command line (directories are searched
+// recursively) is loaded into memory once and then run through each stage:
+//
+//   setTo     ResXMLTree::setTo() or ResTable::setTo()
+//   next      a full walk of the document with next()
+//   stringAt  stringAt() on every string of the (main) string pool
+//   convert   setTo() plus conversion to text with streamXML() or, with
+//             --dom, printXML(); for tables, resolving every resource name
+//
+// For each stage the throughput, the time per item, the number of heap
+// allocations per file and the 50th and 99th percentile of the time per file
+// are printed. Items are the next() events of a document (or the resource
+// names of a table), except for stringAt, where they are the strings.
+//
+// Heap allocations are counted by wrapping malloc(), calloc() and realloc()
+// at link time (-Wl,--wrap=...), so this must be linked with those flags.
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <androidfw/ResourceTypes.h>
+#include <utils/ByteOrder.h>
+#include <utils/StringArena.h>
+#include <utils/Timers.h>
+
+#include "xml_printer.h"
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+// Allocation counting
+
+static size_t gAllocations;
+
+extern "C" {
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t nmemb, size_t size);
+void * __real_realloc(void *ptr, size_t size);
+
+void * __wrap_malloc(size_t size)
+{
+    ++gAllocations;
+    return __real_malloc(size);
+}
+
+void * __wrap_calloc(size_t nmemb, size_t size)
+{
+    ++gAllocations;
+    return __real_calloc(nmemb, size);
+}
+
+void * __wrap_realloc(void *ptr, size_t size)
+{
+    ++gAllocations;
+    return __real_realloc(ptr, size);
+}
+
+}
+
+// Route operator new through malloc() so that the allocations of the C++
+// library are counted as well, whether or not it is linked statically.
+void * operator new(size_t size)
+{
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        // Might be built without exceptions
+        fprintf(stderr, "Error: Out of memory\n");
+        abort();
+    }
+    return ptr;
+}
+
+void * operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+// ---------------------------------------------------------------------------
+// Input files
+
+enum file_type {
+    FILE_XML,
+    FILE_TABLE,
+};
+
+struct input_file {
+    std::string path;
+    file_type type;
+    std::vector<unsigned char> data;
+    // Number of next() events of a document or resource names of a table
+    size_t items;
+};
+
+static bool read_file(const char *path, std::vector<unsigned char> *out)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    unsigned char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        out->insert(out->end(), buf, buf + n);
+    }
+    fclose(fp);
+    return true;
+}
+
+static size_t count_events(ResXMLTree *tree)
+{
+    size_t events = 0;
+    ResXMLParser::event_code_t code;
+    tree->restart();
+    while ((code = tree->next()) != ResXMLParser::END_DOCUMENT
+            && code != ResXMLParser::BAD_DOCUMENT) {
+        ++events;
+    }
+    return events;
+}
+
+// Loads path if it is a binary XML file or a resource table that can be
+// parsed. Anything else is skipped silently when found in a directory.
+static bool add_file(std::vector<input_file> *files, const std::string &path,
+                     bool quiet)
+{
+    input_file file;
+    file.path = path;
+    if (!read_file(path.c_str(), &file.data)) {
+        return false;
+    }
+
+    const uint16_t type = file.data.size() >= sizeof(ResChunk_header)
+            ? dtohs(((const ResChunk_header *) file.data.data())->type) : 0;
+    if (type == RES_XML_TYPE) {
+        ResXMLTree tree;
+        if (tree.setTo(file.data.data(), file.data.size()) != NO_ERROR) {
+            fprintf(stderr, "Warning: Skipping corrupt file %s\n", path.c_str());
+            return true;
+        }
+        file.type = FILE_XML;
+        file.items = count_events(&tree);
+    } else if (type == RES_TABLE_TYPE) {
+        ResTable table;
+        if (table.setTo(file.data.data(), file.data.size()) != NO_ERROR) {
+            fprintf(stderr, "Warning: Skipping corrupt file %s\n", path.c_str());
+            return true;
+        }
+        resource_names names;
+        add_resource_names(&names, table);
+        file.type = FILE_TABLE;
+        file.items = names.size();
+    } else {
+        if (!quiet) {
+            fprintf(stderr, "Warning: Skipping %s: not a binary XML file or "
+                    "resource table\n", path.c_str());
+        }
+        return true;
+    }
+
+    files->push_back(std::move(file));
+    return true;
+}
+
+static bool add_path(std::vector<input_file> *files, const std::string &path,
+                     bool quiet)
+{
+    struct stat sb;
+    if (stat(path.c_str(), &sb) < 0) {
+        fprintf(stderr, "Error: Failed to stat %s: %s\n",
+                path.c_str(), strerror(errno));
+        return false;
+    }
+    if (!S_ISDIR(sb.st_mode)) {
+        return add_file(files, path, quiet);
+    }
+
+    DIR *dp = opendir(path.c_str());
+    if (!dp) {
+        fprintf(stderr, "Error: Failed to open directory %s: %s\n",
+                path.c_str(), strerror(errno));
+        return false;
+    }
+    std::vector<std::string> names;
+    struct dirent *ent;
+    while ((ent = readdir(dp))) {
+        if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
+            names.push_back(ent->d_name);
+        }
+    }
+    closedir(dp);
+
+    // Same order on every run
+    std::sort(names.begin(), names.end());
+    for (const std::string &name : names) {
+        if (!add_path(files, path + "/" + name, true)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Stages
+
+struct bench_context {
+    uint32_t flags;
+    bool useDom;
+    FILE *devNull;
+    ResXMLTree tree;
+    ResTable table;
+    StringArena arena;
+};
+
+// Keeps the compiler from discarding the results.
+static volatile size_t gSink;
+
+// systemTime() only has microsecond resolution on hosts other than Android,
+// which is too coarse for small files.
+static nsecs_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return nsecs_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static nsecs_t bench_set_to(bench_context *ctx, const input_file &file)
+{
+    nsecs_t start;
+    if (file.type == FILE_XML) {
+        ctx->tree.uninit();
+        start = now();
+        ctx->tree.setTo(file.data.data(), file.data.size(), false, ctx->flags);
+    } else {
+        ctx->table.uninit();
+        start = now();
+        ctx->table.setTo(file.data.data(), file.data.size());
+    }
+    return now() - start;
+}
+
+static nsecs_t bench_next(bench_context *ctx, const input_file &file)
+{
+    ctx->tree.setTo(file.data.data(), file.data.size(), false, ctx->flags);
+    const nsecs_t start = now();
+    gSink = count_events(&ctx->tree);
+    return now() - start;
+}
+
+static nsecs_t bench_string_at(bench_context *ctx, const input_file &file)
+{
+    const ResStringPool *pool;
+    if (file.type == FILE_XML) {
+        // A fresh tree each time, so that nothing comes from the decode
+        // caches of the last run
+        ctx->tree.setTo(file.data.data(), file.data.size(), false, ctx->flags);
+        pool = &ctx->tree.getStrings();
+    } else {
+        ctx->table.setTo(file.data.data(), file.data.size());
+        pool = ctx->table.getTableStringBlock();
+    }
+
+    size_t sum = 0;
+    const nsecs_t start = now();
+    const size_t count = pool->size();
+    for (size_t i = 0; i < count; ++i) {
+        size_t len;
+        if (pool->stringAt(i, &len)) {
+            sum += len;
+        }
+    }
+    const nsecs_t elapsed = now() - start;
+    gSink = sum;
+    return elapsed;
+}
+
+static nsecs_t bench_convert(bench_context *ctx, const input_file &file)
+{
+    if (file.type == FILE_XML) {
+        ctx->tree.uninit();
+        const nsecs_t start = now();
+        if (ctx->tree.setTo(file.data.data(), file.data.size(), false,
+                            ctx->flags) == NO_ERROR) {
+#ifdef WITH_PUGIXML
+            if (ctx->useDom) {
+                printXML(&ctx->tree, ctx->devNull, NULL, &ctx->arena);
+            } else {
+                streamXML(&ctx->tree, ctx->devNull, NULL, &ctx->arena);
+            }
+#else
+            streamXML(&ctx->tree, ctx->devNull, NULL, &ctx->arena);
+#endif
+        }
+        fflush(ctx->devNull);
+        return now() - start;
+    } else {
+        ctx->table.uninit();
+        const nsecs_t start = now();
+        resource_names names;
+        if (ctx->table.setTo(file.data.data(), file.data.size()) == NO_ERROR) {
+            add_resource_names(&names, ctx->table);
+        }
+        gSink = names.size();
+        return now() - start;
+    }
+}
+
+static size_t string_count(const input_file &file)
+{
+    if (file.type == FILE_XML) {
+        ResXMLTree tree;
+        tree.setTo(file.data.data(), file.data.size());
+        return tree.getStrings().size();
+    } else {
+        ResTable table;
+        table.setTo(file.data.data(), file.data.size());
+        return table.getTableStringBlock()->size();
+    }
+}
+
+enum item_type {
+    ITEMS_NONE,
+    ITEMS_EVENTS,
+    ITEMS_STRINGS,
+};
+
+struct stage {
+    const char *name;
+    nsecs_t (*fn)(bench_context *, const input_file &);
+    item_type items;
+    bool tables;
+};
+
+static const stage kStages[] = {
+    { "setTo", bench_set_to, ITEMS_NONE, true },
+    { "next", bench_next, ITEMS_EVENTS, false },
+    { "stringAt", bench_string_at, ITEMS_STRINGS, true },
+    { "convert", bench_convert, ITEMS_EVENTS, true },
+};
+
+static double percentile(const std::vector<nsecs_t> &sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    // Nearest rank
+    size_t rank = (size_t) (p / 100 * sorted.size() + 0.5);
+    if (rank > 0) {
+        --rank;
+    }
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+static void run_stage(bench_context *ctx, const stage &s,
+                      const std::vector<input_file> &files,
+                      const std::vector<size_t> &strings, int iterations)
+{
+    std::vector<nsecs_t> samples;
+    size_t bytes = 0;
+    size_t items = 0;
+    size_t allocations = 0;
+    size_t numFiles = 0;
+    nsecs_t total = 0;
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        const input_file &file = files[i];
+        if (file.type == FILE_TABLE && !s.tables) {
+            continue;
+        }
+        ++numFiles;
+
+        // Warm-up run, which also counts the allocations. Those of the
+        // untimed setup of a stage are included.
+        const size_t before = gAllocations;
+        s.fn(ctx, file);
+        allocations += gAllocations - before;
+
+        for (int n = 0; n < iterations; ++n) {
+            const nsecs_t elapsed = s.fn(ctx, file);
+            samples.push_back(elapsed);
+            total += elapsed;
+        }
+
+        bytes += file.data.size();
+        if (s.items == ITEMS_STRINGS) {
+            items += strings[i];
+        } else if (s.items == ITEMS_EVENTS) {
+            items += file.items;
+        }
+    }
+
+    if (numFiles == 0) {
+        return;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    const double seconds = total / 1e9;
+    char perItem[32] = "-";
+    if (items > 0) {
+        snprintf(perItem, sizeof(perItem), "%.1f",
+                 (double) total / ((double) items * iterations));
+    }
+
+    printf("%-10s %6zu %10.1f %9s %11.1f %10.2f %10.2f\n",
+           s.name, numFiles,
+           seconds > 0 ? (double) bytes * iterations / seconds / (1024 * 1024) : 0.0,
+           perItem, (double) allocations / numFiles,
+           percentile(samples, 50) / 1e3, percentile(samples, 99) / 1e3);
+}
+
+static void usage(FILE *stream)
+{
+    fprintf(stream,
+            "Usage: parse_bench [option...] <file or directory>...\n"
+            "\n"
+            "Options:\n"
+            "  -n, --iterations N   Run each stage N times per file (default: 20)\n"
+            "  -f, --flags FLAGS    Flags for ResXMLTree::setTo() (default: 0)\n"
+#ifdef WITH_PUGIXML
+            "  --dom                Convert with printXML() instead of streamXML()\n"
+#endif
+            "  -h, --help           Display this help message\n");
+}
+
+int main(int argc, char *argv[])
+{
+    enum {
+        OPT_DOM = 1000,
+    };
+
+    static const char short_options[] = "n:f:h";
+    static const struct option long_options[] = {
+        {"iterations", required_argument, 0, 'n'},
+        {"flags",      required_argument, 0, 'f'},
+        {"dom",        no_argument,       0, OPT_DOM},
+        {"help",       no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    // Before ctx, whose tree and table point into the files until the end
+    std::vector<input_file> files;
+    bench_context ctx;
+    ctx.flags = 0;
+    ctx.useDom = false;
+    int iterations = 20;
+
+    int opt;
+    int long_index = 0;
+    while ((opt = getopt_long(argc, argv, short_options,
+                              long_options, &long_index)) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'f':
+            ctx.flags = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_DOM:
+#ifdef WITH_PUGIXML
+            ctx.useDom = true;
+            break;
+#else
+            fprintf(stderr, "Error: --dom is not available in this build "
+                    "(built without pugixml)\n");
+            return EXIT_FAILURE;
+#endif
+        case 'h':
+            usage(stdout);
+            return EXIT_SUCCESS;
+        default:
+            usage(stderr);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc || iterations <= 0) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = optind; i < argc; ++i) {
+        if (!add_path(&files, argv[i], false)) {
+            return EXIT_FAILURE;
+        }
+    }
+    if (files.empty()) {
+        fprintf(stderr, "Error: No binary XML files or resource tables found\n");
+        return EXIT_FAILURE;
+    }
+
+    ctx.devNull = fopen("/dev/null", "w");
+    if (!ctx.devNull) {
+        fprintf(stderr, "Error: Failed to open /dev/null: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    size_t numXml = 0;
+    size_t bytes = 0;
+    std::vector<size_t> strings;
+    for (const input_file &file : files) {
+        numXml += file.type == FILE_XML;
+        bytes += file.data.size();
+        strings.push_back(string_count(file));
+    }
+
+    printf("%zu files (%zu binary XML, %zu resource tables), %.2f MB, "
+           "%d iterations, flags 0x%x\n",
+           files.size(), numXml, files.size() - numXml,
+           bytes / (1024.0 * 1024.0), iterations, ctx.flags);
+    printf("%-10s %6s %10s %9s %11s %10s %10s\n",
+           "stage", "files", "MB/s", "ns/item", "allocs/file", "p50 us", "p99 us");
+
+    for (const stage &s : kStages) {
+        run_stage(&ctx, s, files, strings, iterations);
+    }
+
+    fclose(ctx.devNull);
+
+    return EXIT_SUCCESS;
+}
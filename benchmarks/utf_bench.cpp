@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Micro-benchmark for the UTF-8 <-> UTF-16 conversion kernels in
+// libutils/Unicode.cpp. The strings are taken from the string pools of real
+// binary XML files, resources.arsc files or raw string pool dumps given on
+// the command line, and every conversion is timed with each kernel the CPU
+// supports.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <androidfw/ResourceTypes.h>
+#include <utils/ByteOrder.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Unicode.h>
+
+using namespace android;
+
+struct corpus {
+    std::vector<std::string> u8;
+    std::vector<std::u16string> u16;
+    size_t u8Bytes = 0;
+    size_t u16Units = 0;
+};
+
+static bool read_file(const char *path, std::vector<unsigned char> *out)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    unsigned char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        out->insert(out->end(), buf, buf + n);
+    }
+    fclose(fp);
+    return true;
+}
+
+static void add_pool(corpus *c, const ResStringPool &pool)
+{
+    for (size_t i = 0; i < pool.size(); ++i) {
+        size_t len;
+        const char16_t *s16 = pool.stringAt(i, &len);
+        if (!s16) {
+            continue;
+        }
+        String8 s8(s16, len);
+        c->u16.push_back(std::u16string(s16, len));
+        c->u8.push_back(std::string(s8.string(), s8.size()));
+        c->u16Units += len;
+        c->u8Bytes += s8.size();
+    }
+}
+
+// Adds every string pool found among the top-level chunks of "data" (or
+// "data" itself if it is a string pool).
+static void add_file(corpus *c, const unsigned char *data, size_t size)
+{
+    if (size < sizeof(ResChunk_header)) {
+        return;
+    }
+    const ResChunk_header *header = (const ResChunk_header *) data;
+    const uint16_t type = dtohs(header->type);
+    if (type == RES_STRING_POOL_TYPE) {
+        ResStringPool pool(data, size);
+        add_pool(c, pool);
+        return;
+    }
+    if (type != RES_XML_TYPE && type != RES_TABLE_TYPE) {
+        return;
+    }
+
+    const unsigned char *end = data + std::min<size_t>(size, dtohl(header->size));
+    const unsigned char *p = data + dtohs(header->headerSize);
+    while (p + sizeof(ResChunk_header) <= end) {
+        const ResChunk_header *chunk = (const ResChunk_header *) p;
+        const size_t chunkSize = dtohl(chunk->size);
+        if (chunkSize < sizeof(ResChunk_header) || chunkSize > (size_t) (end - p)) {
+            break;
+        }
+        if (dtohs(chunk->type) == RES_STRING_POOL_TYPE) {
+            ResStringPool pool(p, chunkSize);
+            add_pool(c, pool);
+        }
+        p += chunkSize;
+    }
+}
+
+static const char *kernel_name(int kernel)
+{
+    switch (kernel) {
+    case UTF_KERNEL_SCALAR: return "scalar";
+    case UTF_KERNEL_SSE2: return "sse2";
+    case UTF_KERNEL_AVX2: return "avx2";
+    default: return "?";
+    }
+}
+
+// Keeps the compiler from discarding the conversions.
+static volatile size_t gSink;
+
+static double bench_utf8_to_utf16_length(const corpus &c, int iterations)
+{
+    size_t sum = 0;
+    nsecs_t start = systemTime();
+    for (int i = 0; i < iterations; ++i) {
+        for (const std::string &s : c.u8) {
+            sum += utf8_to_utf16_length((const uint8_t *) s.data(), s.size());
+        }
+    }
+    nsecs_t elapsed = systemTime() - start;
+    gSink = sum;
+    return elapsed;
+}
+
+static double bench_utf8_to_utf16(const corpus &c, int iterations)
+{
+    std::vector<char16_t> buf;
+    nsecs_t start = systemTime();
+    for (int i = 0; i < iterations; ++i) {
+        for (const std::string &s : c.u8) {
+            if (buf.size() < s.size() + 1) {
+                buf.resize(s.size() + 1);
+            }
+            utf8_to_utf16((const uint8_t *) s.data(), s.size(), buf.data());
+        }
+    }
+    nsecs_t elapsed = systemTime() - start;
+    gSink = buf.empty() ? 0 : buf[0];
+    return elapsed;
+}
+
+static double bench_utf16_to_utf8_length(const corpus &c, int iterations)
+{
+    size_t sum = 0;
+    nsecs_t start = systemTime();
+    for (int i = 0; i < iterations; ++i) {
+        for (const std::u16string &s : c.u16) {
+            sum += utf16_to_utf8_length(s.data(), s.size());
+        }
+    }
+    nsecs_t elapsed = systemTime() - start;
+    gSink = sum;
+    return elapsed;
+}
+
+static double bench_utf16_to_utf8(const corpus &c, int iterations)
+{
+    std::vector<char> buf;
+    nsecs_t start = systemTime();
+    for (int i = 0; i < iterations; ++i) {
+        for (const std::u16string &s : c.u16) {
+            if (buf.size() < s.size() * 3 + 1) {
+                buf.resize(s.size() * 3 + 1);
+            }
+            utf16_to_utf8(s.data(), s.size(), buf.data());
+        }
+    }
+    nsecs_t elapsed = systemTime() - start;
+    gSink = buf.empty() ? 0 : buf[0];
+    return elapsed;
+}
+
+// Runs all four conversions over the corpus with the current kernel and
+// returns their results back to back, to check the kernels against each
+// other before timing them.
+static std::string convert_all(const corpus &c)
+{
+    std::string out;
+    std::vector<char16_t> buf16;
+    std::vector<char> buf8;
+    for (const std::string &s : c.u8) {
+        const ssize_t len = utf8_to_utf16_length((const uint8_t *) s.data(), s.size());
+        out.append((const char *) &len, sizeof(len));
+        if (len >= 0) {
+            buf16.resize(len + 1);
+            utf8_to_utf16((const uint8_t *) s.data(), s.size(), buf16.data());
+            out.append((const char *) buf16.data(), buf16.size() * sizeof(char16_t));
+        }
+    }
+    for (const std::u16string &s : c.u16) {
+        const ssize_t len = utf16_to_utf8_length(s.data(), s.size());
+        out.append((const char *) &len, sizeof(len));
+        if (len >= 0) {
+            buf8.resize(len + 1);
+            utf16_to_utf8(s.data(), s.size(), buf8.data());
+            out.append(buf8.data(), buf8.size());
+        }
+    }
+    return out;
+}
+
+struct benchmark {
+    const char *name;
+    double (*fn)(const corpus &, int);
+    bool fromUtf8;
+};
+
+static const benchmark kBenchmarks[] = {
+    { "utf8_to_utf16_length", bench_utf8_to_utf16_length, true },
+    { "utf8_to_utf16", bench_utf8_to_utf16, true },
+    { "utf16_to_utf8_length", bench_utf16_to_utf8_length, false },
+    { "utf16_to_utf8", bench_utf16_to_utf8, false },
+};
+
+int main(int argc, char *argv[])
+{
+    int iterations = 100;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        iterations = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || iterations <= 0) {
+        fprintf(stderr, "Usage: utf_bench [-n iterations] <file>...\n");
+        return EXIT_FAILURE;
+    }
+
+    corpus c;
+    for (int i = first; i < argc; ++i) {
+        std::vector<unsigned char> data;
+        if (!read_file(argv[i], &data)) {
+            return EXIT_FAILURE;
+        }
+        add_file(&c, data.data(), data.size());
+    }
+    if (c.u8.empty()) {
+        fprintf(stderr, "Error: No strings found\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu strings, %zu UTF-8 bytes, %zu UTF-16 units, %d iterations\n",
+           c.u8.size(), c.u8Bytes, c.u16Units, iterations);
+
+    const int defaultKernel = utf_current_kernel();
+    const int kernels[] = { UTF_KERNEL_SCALAR, UTF_KERNEL_SSE2, UTF_KERNEL_AVX2 };
+
+    utf_select_kernel(UTF_KERNEL_SCALAR);
+    const std::string expected = convert_all(c);
+    for (int kernel : kernels) {
+        if (utf_select_kernel(kernel) == 0 && convert_all(c) != expected) {
+            fprintf(stderr, "Error: %s results differ from scalar\n",
+                    kernel_name(kernel));
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (const benchmark &b : kBenchmarks) {
+        const double bytes = (double) iterations
+                * (b.fromUtf8 ? c.u8Bytes : c.u16Units * sizeof(char16_t));
+        double scalarTime = 0;
+        for (int kernel : kernels) {
+            if (utf_select_kernel(kernel) != 0) {
+                continue;
+            }
+            const double elapsed = b.fn(c, iterations);
+            if (kernel == UTF_KERNEL_SCALAR) {
+                scalarTime = elapsed;
+            }
+            printf("%-22s %-7s %9.1f MB/s  %5.2fx\n", b.name, kernel_name(kernel),
+                   bytes / (elapsed / 1e9) / (1024 * 1024),
+                   elapsed > 0 ? scalarTime / elapsed : 0.0);
+        }
+    }
+
+    utf_select_kernel(defaultKernel);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// main() for the fuzz targets when libFuzzer is not available. It runs every
+// file given on the command line (directories are searched recursively)
+// through LLVMFuzzerTestOneInput() and reports the number of executions per
+// second, so that corpora can be replayed with any compiler and sanitizer.
+//
+// This is also enough for AFL: afl-fuzz -i <seeds> -o <out> -- <target> @@
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <time.h>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool read_file(const char *path, std::vector<uint8_t> *out)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        out->insert(out->end(), buf, buf + n);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool add_path(std::vector<std::string> *files, const std::string &path)
+{
+    struct stat sb;
+    if (stat(path.c_str(), &sb) < 0) {
+        fprintf(stderr, "Error: Failed to stat %s: %s\n",
+                path.c_str(), strerror(errno));
+        return false;
+    }
+    if (!S_ISDIR(sb.st_mode)) {
+        files->push_back(path);
+        return true;
+    }
+
+    DIR *dp = opendir(path.c_str());
+    if (!dp) {
+        fprintf(stderr, "Error: Failed to open directory %s: %s\n",
+                path.c_str(), strerror(errno));
+        return false;
+    }
+    std::vector<std::string> names;
+    struct dirent *ent;
+    while ((ent = readdir(dp))) {
+        if (ent->d_name[0] != '.') {
+            names.push_back(ent->d_name);
+        }
+    }
+    closedir(dp);
+
+    std::sort(names.begin(), names.end());
+    for (const std::string &name : names) {
+        if (!add_path(files, path + "/" + name)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void usage(FILE *stream, const char *prog)
+{
+    fprintf(stream,
+            "Usage: %s [-n runs] <file or directory>...\n"
+            "\n"
+            "Runs each input through the fuzz target <runs> times (default: 1)\n"
+            "and prints the number of executions per second.\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            runs = atoi(optarg);
+            break;
+        case 'h':
+            usage(stdout, argv[0]);
+            return EXIT_SUCCESS;
+        default:
+            usage(stderr, argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc || runs <= 0) {
+        usage(stderr, argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> files;
+    for (int i = optind; i < argc; ++i) {
+        if (!add_path(&files, argv[i])) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    size_t execs = 0;
+    size_t bytes = 0;
+    double total = 0;
+    double slowest = 0;
+    std::string slowestPath;
+
+    for (const std::string &path : files) {
+        // Exactly the size of the input, so that overreads are caught
+        std::vector<uint8_t> data;
+        if (!read_file(path.c_str(), &data)) {
+            return EXIT_FAILURE;
+        }
+        uint8_t *copy = (uint8_t *) malloc(data.size() ? data.size() : 1);
+        if (!copy) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return EXIT_FAILURE;
+        }
+
+        if (!data.empty()) {
+            memcpy(copy, data.data(), data.size());
+        }
+
+        const double start = now();
+        for (int n = 0; n < runs; ++n) {
+            LLVMFuzzerTestOneInput(copy, data.size());
+        }
+        const double elapsed = (now() - start) / runs;
+        free(copy);
+
+        if (elapsed > slowest) {
+            slowest = elapsed;
+            slowestPath = path;
+        }
+        total += elapsed * runs;
+        execs += runs;
+        bytes += data.size() * runs;
+    }
+
+    printf("%zu inputs, %zu execs in %.3f s: %.0f execs/s, %.1f MB/s\n",
+           files.size(), execs, total,
+           total > 0 ? execs / total : 0.0,
+           total > 0 ? bytes / total / (1024 * 1024) : 0.0);
+    if (!slowestPath.empty()) {
+        printf("Slowest input: %s (%.3f ms)\n",
+               slowestPath.c_str(), slowest * 1e3);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fuzz target for ResStringPool. The input is a string pool chunk. Every
+// string and style is read and looked up again with indexOfString(), first
+// from a plain pool and then from pools using each of the decode caches and
+// the string index, which must return the same strings. The lookups are
+// checked against a linear scan with strzcmp16(), and for UTF-8 pools,
+// strzcmp16_utf8() is checked against strzcmp16() on the decoded strings.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <androidfw/ResourceTypes.h>
+#include <logging.h>
+#include <utils/String8.h>
+#include <utils/Unicode.h>
+
+using namespace android;
+
+static void check(bool cond, const char *what)
+{
+    if (!cond) {
+        fprintf(stderr, "Check failed: %s\n", what);
+        abort();
+    }
+}
+
+static int sign(int c)
+{
+    return (c > 0) - (c < 0);
+}
+
+// Whether every string decodes and they are in strzcmp16() order, which is
+// what the binary search of a SORTED_FLAG pool relies on
+static bool really_sorted(const ResStringPool &pool)
+{
+    const char16_t *prev = NULL;
+    size_t prevLen = 0;
+    for (size_t i = 0; i < pool.size(); ++i) {
+        size_t len;
+        const char16_t *str = pool.stringAt(i, &len);
+        if (!str || (prev && strzcmp16(prev, prevLen, str, len) > 0)) {
+            return false;
+        }
+        prev = str;
+        prevLen = len;
+    }
+    return true;
+}
+
+// Whether the UTF-8 form of a string is the one that converting its UTF-16
+// form back produces. Searches of unsorted or indexed UTF-8 pools compare
+// those bytes.
+static bool round_trips(const char *str8, size_t len8, const char16_t *str,
+                        size_t len)
+{
+    const String8 converted(str, len);
+    return converted.size() == len8
+            && memcmp(converted.string(), str8, len8) == 0;
+}
+
+static void walk(const ResStringPool &pool, bool indexed = false)
+{
+    const bool mustFind = !pool.isSorted() || really_sorted(pool);
+
+    for (size_t i = 0; i < pool.size(); ++i) {
+        size_t len;
+        size_t len8;
+        const char16_t *str = pool.stringAt(i, &len);
+        const char *str8 = pool.string8At(i, &len8);
+        pool.string8ObjectAt(i);
+
+        if (!str) {
+            continue;
+        }
+
+        const ssize_t idx = pool.indexOfString(str, len);
+        if (idx >= 0) {
+            size_t foundLen;
+            const char16_t *found = pool.stringAt(idx, &foundLen);
+            // UTF-8 pools are searched by their UTF-8 form, which can match a
+            // corrupt string that has no UTF-16 form
+            check(!found || strzcmp16(found, foundLen, str, len) == 0,
+                  "indexOfString() returned a different string");
+        } else if (mustFind && (!pool.isUTF8()
+                || (pool.isSorted() && !indexed)
+                || (str8 && round_trips(str8, len8, str, len)))) {
+            // A linear scan finds at least string i itself
+            check(false, "indexOfString() missed a string");
+        }
+
+        // Compared with the next string, which covers both orders
+        if (str8 && i + 1 < pool.size()) {
+            size_t nextLen;
+            size_t nextLen8;
+            const char16_t *next = pool.stringAt(i + 1, &nextLen);
+            const char *next8 = pool.string8At(i + 1, &nextLen8);
+            if (next && next8) {
+                check(sign(strzcmp16_utf8((const uint8_t *) str8, len8,
+                                          next, nextLen))
+                        == sign(strzcmp16(str, len, next, nextLen)),
+                      "strzcmp16_utf8() and strzcmp16() disagree");
+                check(sign(strzcmp16_utf8((const uint8_t *) next8, nextLen8,
+                                          str, len))
+                        == sign(strzcmp16(next, nextLen, str, len)),
+                      "strzcmp16_utf8() and strzcmp16() disagree");
+            }
+        }
+    }
+
+    // setTo() has checked that the style data ends with an END span
+    for (size_t i = 0; i < pool.styleCount(); ++i) {
+        const ResStringPool_span *span = pool.styleAt(i);
+        while (span && span->name.index != ResStringPool_span::END) {
+            size_t len;
+            pool.stringAt(span->name, &len);
+            ++span;
+        }
+    }
+}
+
+// Every string of pool must be the same as in the plain pool.
+static void compare(const ResStringPool &plain, const ResStringPool &pool,
+                    const char *what)
+{
+    check(pool.size() == plain.size(), what);
+    for (size_t i = 0; i < plain.size(); ++i) {
+        size_t len1;
+        size_t len2;
+        const char16_t *s1 = plain.stringAt(i, &len1);
+        const char16_t *s2 = pool.stringAt(i, &len2);
+        check(!s1 == !s2, what);
+        if (s1) {
+            check(len1 == len2 && strzcmp16(s1, len1, s2, len2) == 0, what);
+        }
+    }
+}
+
+static void discard_log(void *, int, const char *, const char *)
+{
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    // Messages are still formatted, but not printed
+    static const bool quiet = (setLogSink(discard_log), true);
+    (void) quiet;
+
+    ResDiagnostics diag;
+    ResStringPool plain;
+    plain.setDiagnostics(&diag);
+    const status_t err = plain.setTo(data, size);
+    check((err == BAD_TYPE) == (diag.code != ResDiagnostics::NONE),
+          "setTo() and its diagnostics disagree");
+    if (err != NO_ERROR) {
+        return 0;
+    }
+    walk(plain);
+
+    ResStringPool lockFree;
+    if (lockFree.setTo(data, size, false,
+            ResStringPool::LOCK_FREE_CACHE_FLAG) == NO_ERROR) {
+        walk(lockFree);
+        compare(plain, lockFree, "LOCK_FREE_CACHE_FLAG changed a string");
+    }
+
+    // Fails if any string cannot be decoded
+    ResStringPool eager;
+    if (eager.setTo(data, size, false,
+            ResStringPool::EAGER_DECODE_FLAG) == NO_ERROR) {
+        walk(eager);
+        compare(plain, eager, "EAGER_DECODE_FLAG changed a string");
+    }
+
+    ResStringPool indexed;
+    if (indexed.setTo(data, size, false,
+            ResStringPool::STRING_INDEX_FLAG) == NO_ERROR) {
+        walk(indexed, true);
+        compare(plain, indexed, "STRING_INDEX_FLAG changed a string");
+    }
+
+    return 0;
+}
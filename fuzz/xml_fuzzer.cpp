@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fuzz target for ResXMLTree. The input is parsed with setTo() and walked
+// with next(), calling every accessor at each event, looking up the names
+// that were found with indexOfString() and indexOfAttribute().
+//
+// Each input is parsed twice: once as is and once with the fast paths on
+// (VALIDATE_ONCE_FLAG, the string pool flags and the event index). Both
+// walks must return the same events, and the attribute view must agree with
+// the getAttribute*() accessors. skipCurrentElement() is called at every
+// START_TAG with and without the event index, and both must stop at the same
+// END_TAG. A document must also be rejected with a diagnostic if and only if
+// it is rejected at all. Any difference aborts.
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <androidfw/ResourceTypes.h>
+#include <logging.h>
+#include <utils/String8.h>
+#include <utils/Unicode.h>
+
+using namespace android;
+
+static void check(bool cond, const char *what)
+{
+    if (!cond) {
+        fprintf(stderr, "Check failed: %s\n", what);
+        abort();
+    }
+}
+
+static uint64_t mix(uint64_t hash, uint64_t value)
+{
+    // FNV-1a, one word at a time
+    return (hash ^ value) * 0x100000001b3ULL;
+}
+
+// Looks str up in pool. A string that is found must be equal to str.
+static void check_lookup(const ResStringPool &pool, const char16_t *str,
+                         size_t len)
+{
+    if (!str) {
+        return;
+    }
+    const ssize_t idx = pool.indexOfString(str, len);
+    if (idx >= 0) {
+        size_t foundLen;
+        const char16_t *found = pool.stringAt(idx, &foundLen);
+        // UTF-8 pools are searched by their UTF-8 form, which can match a
+        // corrupt string that has no UTF-16 form
+        check(!found || strzcmp16(found, foundLen, str, len) == 0,
+              "indexOfString() returned a different string");
+    }
+}
+
+static uint64_t walk_attributes(const ResXMLTree &tree, uint64_t hash)
+{
+    const ResStringPool &pool = tree.getStrings();
+    const size_t count = tree.getAttributeCount();
+    const ResXMLParser::AttributeView attrs = tree.getAttributes();
+    check(attrs.size() == count, "attribute view has the wrong size");
+
+    for (size_t i = 0; i < count; ++i) {
+        size_t len;
+        size_t nsLen = 0;
+        size_t len8;
+        const char16_t *ns = tree.getAttributeNamespace(i, &nsLen);
+        const char16_t *name = tree.getAttributeName(i, &len);
+        tree.getAttributeNamespace8(i, &len8);
+        tree.getAttributeName8(i, &len8);
+        tree.getAttributeStringValue(i, &len8);
+
+        Res_value value;
+        const ssize_t valueIdx = tree.getAttributeValue(i, &value);
+        const ResXMLParser::ResXMLAttribute attr = attrs[i];
+        check(attr.ns == tree.getAttributeNamespaceID(i)
+                && attr.name == tree.getAttributeNameID(i)
+                && attr.rawValue == tree.getAttributeValueStringID(i),
+              "attribute view disagrees with getAttribute*ID()");
+        // getAttributeDataType() reports dynamic references as references
+        const int32_t type =
+                attr.typedValue.dataType == Res_value::TYPE_DYNAMIC_REFERENCE
+                ? Res_value::TYPE_REFERENCE : attr.typedValue.dataType;
+        check(type == tree.getAttributeDataType(i)
+                && (int32_t) attr.typedValue.data == tree.getAttributeData(i),
+              "attribute view disagrees with getAttributeData*()");
+        if (valueIdx >= 0) {
+            check(value.dataType == attr.typedValue.dataType
+                    && value.data == attr.typedValue.data,
+                  "attribute view disagrees with getAttributeValue()");
+        }
+
+        hash = mix(hash, attr.ns);
+        hash = mix(hash, attr.name);
+        hash = mix(hash, attr.rawValue);
+        hash = mix(hash, attr.typedValue.dataType);
+        hash = mix(hash, attr.typedValue.data);
+
+        const uint32_t resId = tree.getAttributeNameResID(i);
+        if (resId != 0) {
+            const ssize_t idx = tree.indexOfAttributeByResId(resId);
+            check(idx >= 0 && (size_t) idx < count
+                    && tree.getAttributeNameResID(idx) == resId,
+                  "indexOfAttributeByResId() returned a different attribute");
+        }
+
+        if (name) {
+            const ssize_t idx = tree.indexOfAttribute(ns, ns ? nsLen : 0,
+                                                      name, len);
+            check(idx < (ssize_t) count,
+                  "indexOfAttribute() returned an index out of range");
+            String8 ns8(ns ? ns : u"", ns ? nsLen : 0);
+            String8 name8(name, len);
+            tree.indexOfAttribute(ns ? ns8.string() : NULL, name8.string());
+        }
+        check_lookup(pool, name, len);
+    }
+
+    // Iterators must outlive the view they came from
+    ResXMLParser::AttributeView::iterator it = tree.getAttributes().begin();
+    const ResXMLParser::AttributeView::iterator end = tree.getAttributes().end();
+    for (size_t i = 0; i < count; ++i, ++it) {
+        const ResXMLParser::ResXMLAttribute a = *it;
+        const ResXMLParser::ResXMLAttribute b = attrs[i];
+        check(it != end && a.ns == b.ns && a.name == b.name
+                && a.rawValue == b.rawValue
+                && a.typedValue.dataType == b.typedValue.dataType
+                && a.typedValue.data == b.typedValue.data,
+              "attribute iterator disagrees with the view");
+    }
+    check(it == end, "attribute iterator does not end with the view");
+
+    tree.indexOfID();
+    tree.indexOfClass();
+    tree.indexOfStyle();
+    return hash;
+}
+
+// Walks the whole document and returns a digest of the events.
+static uint64_t walk(ResXMLTree *tree)
+{
+    const ResStringPool &pool = tree->getStrings();
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    ResXMLParser::event_code_t code;
+    size_t len;
+
+    tree->restart();
+    while ((code = tree->next()) != ResXMLParser::END_DOCUMENT
+            && code != ResXMLParser::BAD_DOCUMENT) {
+        hash = mix(hash, code);
+        hash = mix(hash, tree->getLineNumber());
+        hash = mix(hash, tree->getCommentID());
+        tree->getComment(&len);
+
+        switch (code) {
+        case ResXMLParser::START_NAMESPACE:
+        case ResXMLParser::END_NAMESPACE: {
+            hash = mix(hash, tree->getNamespacePrefixID());
+            hash = mix(hash, tree->getNamespaceUriID());
+            tree->getNamespacePrefix(&len);
+            const char16_t *uri = tree->getNamespaceUri(&len);
+            check_lookup(pool, uri, len);
+            break;
+        }
+        case ResXMLParser::START_TAG:
+        case ResXMLParser::END_TAG: {
+            hash = mix(hash, tree->getElementNamespaceID());
+            hash = mix(hash, tree->getElementNameID());
+            tree->getElementNamespace(&len);
+            const char16_t *name = tree->getElementName(&len);
+            check_lookup(pool, name, len);
+            if (code == ResXMLParser::START_TAG) {
+                hash = walk_attributes(*tree, hash);
+            }
+            break;
+        }
+        case ResXMLParser::TEXT: {
+            hash = mix(hash, tree->getTextID());
+            tree->getText(&len);
+            Res_value value;
+            tree->getTextValue(&value);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return mix(hash, code);
+}
+
+// Where a skipCurrentElement() call landed
+struct skip_result {
+    ResXMLParser::event_code_t code;
+    uint32_t line;
+    int32_t name;
+};
+
+// Calls skipCurrentElement() at each START_TAG (up to a limit, since every
+// skip walks to the end of its element) and returns where each skip landed.
+// The position is restored after each one.
+static std::vector<skip_result> skip_elements(ResXMLTree *tree)
+{
+    std::vector<skip_result> results;
+    ResXMLParser::ResXMLPosition pos;
+    ResXMLParser::event_code_t code;
+
+    tree->restart();
+    while ((code = tree->next()) != ResXMLParser::END_DOCUMENT
+            && code != ResXMLParser::BAD_DOCUMENT && results.size() < 1000) {
+        if (code != ResXMLParser::START_TAG) {
+            continue;
+        }
+        tree->getPosition(&pos);
+        skip_result r = { tree->skipCurrentElement(), 0, -1 };
+        check(r.code == ResXMLParser::END_TAG
+                || r.code == ResXMLParser::END_DOCUMENT
+                || r.code == ResXMLParser::BAD_DOCUMENT,
+              "skipCurrentElement() stopped at the wrong event");
+        if (r.code == ResXMLParser::END_TAG) {
+            r.line = tree->getLineNumber();
+            r.name = tree->getElementNameID();
+        }
+        results.push_back(r);
+        tree->setPosition(pos);
+    }
+    return results;
+}
+
+// Compares skips without the event index with the indexed ones. The index
+// ends at the first invalid node, but the walk without it only checks the
+// chunk headers of the nodes it skips, so it may go past that node.
+static void check_skips(const std::vector<skip_result> &unindexed,
+                        const std::vector<skip_result> &indexed)
+{
+    check(unindexed.size() == indexed.size(),
+          "skipCurrentElement() was called at different events");
+    for (size_t i = 0; i < unindexed.size() && i < indexed.size(); ++i) {
+        if (indexed[i].code == ResXMLParser::BAD_DOCUMENT) {
+            continue;
+        }
+        check(unindexed[i].code == indexed[i].code
+                && unindexed[i].line == indexed[i].line
+                && unindexed[i].name == indexed[i].name,
+              "skipCurrentElement() without the index stopped elsewhere");
+    }
+}
+
+static void discard_log(void *, int, const char *, const char *)
+{
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    // Messages are still formatted, but not printed
+    static const bool quiet = (setLogSink(discard_log), true);
+    (void) quiet;
+
+    ResDiagnostics diag;
+    ResXMLTree plain;
+    plain.setDiagnostics(&diag);
+    const status_t plainErr = plain.setTo(data, size);
+    check((plainErr == BAD_TYPE) == (diag.code != ResDiagnostics::NONE),
+          "setTo() and its diagnostics disagree");
+    const uint64_t plainHash = plainErr == NO_ERROR ? walk(&plain) : 0;
+    // Without the index, skipCurrentElement() only checks chunk headers
+    std::vector<skip_result> plainSkips;
+    if (plainErr == NO_ERROR) {
+        plainSkips = skip_elements(&plain);
+    }
+    if (plainErr == NO_ERROR) {
+        check((plain.getEventType() == ResXMLParser::BAD_DOCUMENT)
+                == (diag.code != ResDiagnostics::NONE),
+              "next() and its diagnostics disagree");
+    }
+    // Data too short for a chunk header is reported at offset 0
+    check(diag.offset < size || diag.offset == 0
+            || diag.code == ResDiagnostics::NONE,
+          "diagnostic offset out of range");
+
+    ResXMLTree fast;
+    const status_t fastErr = fast.setTo(data, size, false,
+            ResXMLTree::VALIDATE_ONCE_FLAG
+            | ResStringPool::LOCK_FREE_CACHE_FLAG
+            | ResStringPool::STRING_INDEX_FLAG);
+    if (fastErr != NO_ERROR) {
+        check(plainErr != NO_ERROR, "fast paths rejected a valid document");
+        return 0;
+    }
+    check(plainErr == NO_ERROR, "fast paths accepted an invalid document");
+
+    check(walk(&fast) == plainHash,
+          "VALIDATE_ONCE_FLAG changed the events");
+
+    const std::vector<skip_result> fastSkips = skip_elements(&fast);
+
+    if (fast.buildIndex() == NO_ERROR) {
+        check(walk(&fast) == plainHash, "the event index changed the events");
+        const std::vector<skip_result> indexedSkips = skip_elements(&fast);
+        check_skips(plainSkips, indexedSkips);
+        check_skips(fastSkips, indexedSkips);
+    }
+
+    return 0;
+}
@@ -20,9 +20,13 @@
 #ifndef _LIBS_UTILS_RESOURCE_TYPES_H
 #define _LIBS_UTILS_RESOURCE_TYPES_H
 
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 #include <utils/String16.h>
+#include <utils/Timers.h>
 
 #include <stdint.h>
 #include <sys/types.h>
@@ -336,21 +340,93 @@ struct ResStringPool_span
     uint32_t firstChar, lastChar;
 };
 
+/**
+ * Why ResStringPool or ResXMLTree rejected their data.  They fill one in
+ * when it is passed to setDiagnostics(); otherwise the checks only return
+ * BAD_TYPE and log.  Only the first error is kept, and setTo() clears it.
+ *
+ * actual is the value that was found and expected the limit that it broke
+ * (a minimum size, the bytes available, ...); the comments below list them
+ * in that order.
+ */
+struct ResDiagnostics
+{
+    enum Code {
+        NONE = 0,
+        // Chunk headers (any chunk)
+        CHUNK_HEADER_TOO_SMALL,     // headerSize vs the minimum
+        CHUNK_SMALLER_THAN_HEADER,  // size vs headerSize
+        CHUNK_MISALIGNED,           // size or headerSize vs the next multiple of 4
+        CHUNK_PAST_END,             // size vs the bytes left in the data
+        // String pools
+        ENTRIES_PAST_END,           // end of the string or style offsets vs the data size
+        STRINGS_PAST_END,           // stringsStart vs the pool size
+        STYLES_PAST_END,            // stylesStart vs the pool size
+        STYLES_BEFORE_STRINGS,      // stylesStart vs stringsStart
+        EMPTY_STRING_POOL,          // string data size (0) vs stringCount
+        STRINGS_NOT_TERMINATED,
+        STYLES_NOT_TERMINATED,
+        // XML nodes
+        NODE_TOO_SMALL,             // node data size vs the minimum for its type
+        ATTRIBUTES_PAST_END,        // end of the attributes vs the node data size
+        NO_ROOT_ELEMENT
+    };
+
+    ResDiagnostics() { clear(); }
+
+    void clear();
+    static const char* codeName(Code code);
+
+    Code        code;
+    // Of the chunk at fault, from the start of the data given to setTo()
+    size_t      offset;
+    uint16_t    chunkType;
+    uint64_t    expected;
+    uint64_t    actual;
+};
+
 /**
  * Convenience class for accessing data in a ResStringPool resource.
  */
 class ResStringPool
 {
 public:
+    // Flags for setTo().
+    enum {
+        // Cache decoded UTF-8 strings without taking mDecodeLock.  Cache
+        // slots are published with a compare-and-swap and the decoded
+        // strings are carved out of a single arena, so readers never block
+        // each other and uninit() releases everything with one free().
+        LOCK_FREE_CACHE_FLAG = 1<<0,
+
+        // Transcode a whole UTF-8 pool to UTF-16 up front, in one pass,
+        // into a packed buffer indexed by an offset table.  stringAt() is
+        // then a bounds check plus a pointer add.  decodeTime() and
+        // decodedBytes() report what the decode cost.
+        EAGER_DECODE_FLAG = 1<<1,
+
+        // Have indexOfString() build a hash table of the raw UTF-8 or
+        // UTF-16 string data on its first call and answer every lookup
+        // from it, instead of scanning (unsorted pools) or binary
+        // searching with conversions (sorted UTF-8 pools).
+        STRING_INDEX_FLAG = 1<<2
+    };
+
     ResStringPool();
-    ResStringPool(const void* data, size_t size, bool copyData=false);
+    ResStringPool(const void* data, size_t size, bool copyData=false,
+                  uint32_t flags=0);
     ~ResStringPool();
 
     void setToEmpty();
-    status_t setTo(const void* data, size_t size, bool copyData=false);
+    status_t setTo(const void* data, size_t size, bool copyData=false,
+                   uint32_t flags=0);
 
     status_t getError() const;
 
+    // Reports why setTo() fails into diag, which must outlive the pool.
+    // Offsets are from base, or from the data given to setTo() if NULL.
+    void setDiagnostics(ResDiagnostics* diag, const void* base=NULL);
+
     void uninit();
 
     // Return string entry as UTF16; if the pool is UTF8, the string will
@@ -379,8 +455,25 @@ public:
     bool isSorted() const;
     bool isUTF8() const;
 
+    // Cost of EAGER_DECODE_FLAG decoding; both are 0 if it was not done.
+    nsecs_t decodeTime() const;
+    size_t decodedBytes() const;
+
 private:
+    struct StringIndex;
+
+    status_t decodeAll();
+    status_t initLockFreeCache();
+    bool allocCache() const;
+    const char16_t* swapToCache(size_t idx, const uint16_t* str,
+                                size_t u16len) const;
+    const StringIndex* getStringIndex() const;
+    const char16_t* decodeLockFree(size_t idx, const uint8_t* u8str, size_t u8len,
+                                   size_t u16len) const;
+
     status_t                    mError;
+    ResDiagnostics*             mDiag;
+    const void*                 mDiagBase;
     void*                       mOwnedData;
     const ResStringPool_header* mHeader;
     size_t                      mSize;
@@ -392,6 +485,32 @@ private:
     uint32_t                    mStringPoolSize;    // number of uint16_t
     const uint32_t*             mStyles;
     uint32_t                    mStylePoolSize;    // number of uint32_t
+
+    // LOCK_FREE_CACHE_FLAG state.  The slot table and the arena live in one
+    // allocation starting at mLockFreeCache.
+    std::atomic<char16_t*>*     mLockFreeCache;
+    char16_t*                   mArena;
+    size_t                      mArenaSize;         // number of char16_t
+    mutable std::atomic<size_t> mArenaUsed;
+
+    // EAGER_DECODE_FLAG state.  String i occupies [mDecodedOffsets[i],
+    // mDecodedOffsets[i+1]) in mDecoded, including its terminator; an empty
+    // range marks a string that failed to decode.  Both live in one
+    // allocation starting at mDecodedOffsets.
+    uint32_t*                   mDecodedOffsets;
+    char16_t*                   mDecoded;
+    size_t                      mDecodedBytes;
+    nsecs_t                     mDecodeTime;
+
+    // STRING_INDEX_FLAG state.  The index is built by the first
+    // indexOfString() call and published with a compare-and-swap.
+    bool                        mUseStringIndex;
+    mutable std::atomic<StringIndex*> mStringIndex;
+
+    // Data not in host byte order is swapped as it is read, except for the
+    // header and the styles, which are swapped once into these.
+    ResStringPool_header        mHostHeader;
+    uint32_t*                   mHostStyles;
 };
 
 /**
@@ -563,6 +682,83 @@ public:
         event_code_t                eventCode;
         const ResXMLTree_node*      curNode;
         const void*                 curExt;
+        ssize_t                     eventIndex;
+    };
+
+    // One event of a document indexed by ResXMLTree::buildIndex().  Links
+    // are event indices, or -1 if there is no such event.
+    struct ResXMLEvent
+    {
+        event_code_t                eventCode;
+        // Number of elements enclosing the event.  A START_TAG and its
+        // END_TAG have the same depth.
+        uint32_t                    depth;
+        const ResXMLTree_node*      node;
+        const void*                 ext;
+        // Enclosing START_TAG
+        int32_t                     parent;
+        // START_TAG only: first event inside the element, excluding its
+        // END_TAG
+        int32_t                     firstChild;
+        // Next event with the same parent, skipping over the contents of
+        // an element (never an END_TAG)
+        int32_t                     nextSibling;
+        // Matching END_TAG of a START_TAG and vice versa
+        int32_t                     match;
+    };
+
+    // One attribute of a START_TAG.  The string references are indices
+    // into getStrings(), or -1 if not present.  typedValue is in host
+    // byte order, as from getAttributeValue().
+    struct ResXMLAttribute
+    {
+        int32_t                     ns;
+        int32_t                     name;
+        int32_t                     rawValue;
+        Res_value                   typedValue;
+    };
+
+    // The attributes of a START_TAG, located once.  Each attribute is read
+    // in a single access instead of recomputing its address in every
+    // getAttribute*() call.  The view and its iterators stay valid as long
+    // as the tree's data does; iterators do not refer back to the view.
+    class AttributeView
+    {
+    public:
+        class iterator
+        {
+        public:
+            ResXMLAttribute operator*() const { return read(mBase + mStride*mIdx); }
+            iterator& operator++() { ++mIdx; return *this; }
+            bool operator==(const iterator& o) const { return mIdx == o.mIdx; }
+            bool operator!=(const iterator& o) const { return mIdx != o.mIdx; }
+
+        private:
+            friend class AttributeView;
+            iterator(const uint8_t* base, size_t stride, size_t idx)
+                : mBase(base), mStride(stride), mIdx(idx) {}
+
+            const uint8_t*          mBase;
+            size_t                  mStride;
+            size_t                  mIdx;
+        };
+
+        AttributeView() : mBase(NULL), mStride(0), mCount(0) {}
+
+        size_t size() const { return mCount; }
+        ResXMLAttribute operator[](size_t idx) const { return read(mBase + mStride*idx); }
+        iterator begin() const { return iterator(mBase, mStride, 0); }
+        iterator end() const { return iterator(mBase, mStride, mCount); }
+
+    private:
+        friend class ResXMLParser;
+
+        // Reads the ResXMLTree_attribute at attr
+        static ResXMLAttribute read(const uint8_t* attr);
+
+        const uint8_t*              mBase;
+        size_t                      mStride;
+        size_t                      mCount;
     };
 
     void restart();
@@ -574,6 +770,14 @@ public:
     // START_TAG of the first element.
     event_code_t next();
 
+    // At a START_TAG, moves to the matching END_TAG without visiting the
+    // events in between and returns END_TAG, or END_DOCUMENT/BAD_DOCUMENT
+    // if the element is never closed.  Uses the event index if the tree
+    // has one; otherwise only the chunk headers of the skipped nodes are
+    // checked.  At any other event, returns the current event and does
+    // not move.
+    event_code_t skipCurrentElement();
+
     // These are available for all nodes:
     int32_t getCommentID() const;
     const char16_t* getComment(size_t* outLen) const;
@@ -600,6 +804,9 @@ public:
     // associated with a START_TAG:
     
     size_t getAttributeCount() const;
+
+    // All attributes of the current START_TAG; empty for other events.
+    AttributeView getAttributes() const;
     
     // Returns -1 if no namespace, -2 if idx out of range.
     int32_t getAttributeNamespaceID(size_t idx) const;
@@ -624,6 +831,12 @@ public:
     ssize_t indexOfAttribute(const char16_t* ns, size_t nsLen,
                              const char16_t* attr, size_t attrLen) const;
 
+    // Finds an attribute of the current START_TAG by the resource ID of its
+    // name (e.g. android:name is 0x01010003) using the tree's resource map.
+    // No strings are compared or converted, and the ID is looked up in a
+    // per-tree index that is built on first use.
+    ssize_t indexOfAttributeByResId(uint32_t resId) const;
+
     ssize_t indexOfID() const;
     ssize_t indexOfClass() const;
     ssize_t indexOfStyle() const;
@@ -631,15 +844,29 @@ public:
     void getPosition(ResXMLPosition* pos) const;
     void setPosition(const ResXMLPosition& pos);
 
+    // Index of the current event in the tree's event index, or -1 if the
+    // tree has no index or the parser was not positioned through it.
+    ssize_t getEventIndex() const;
+
+    // Moves to an event or to the Nth START_TAG of an indexed tree in
+    // constant time.  Returns NO_INIT if the tree has no index and
+    // BAD_INDEX if there is no such event.  next() continues from there.
+    status_t seekToEvent(size_t idx);
+    status_t seekToElement(size_t n);
+
 private:
     friend class ResXMLTree;
     
     event_code_t nextNode();
+    void setEvent(size_t idx);
 
     const ResXMLTree&           mTree;
     event_code_t                mEventCode;
     const ResXMLTree_node*      mCurNode;
     const void*                 mCurExt;
+    // Current position in the tree's event index.  -1 before the first
+    // event, -2 if the parser is walking the chunks directly.
+    ssize_t                     mEventIndex;
 };
 
 /**
@@ -648,31 +875,499 @@ private:
 class ResXMLTree : public ResXMLParser
 {
 public:
+    // Flags for setTo().  The ResStringPool flags may be combined with
+    // these and are passed on to the string pool of the tree.
+    enum {
+        // Walk and validate every node once in setTo().  If the whole
+        // document is valid, next() no longer checks the nodes it visits;
+        // otherwise parsing behaves as without the flag.
+        VALIDATE_ONCE_FLAG = 1<<16
+    };
+
     ResXMLTree();
     ~ResXMLTree();
 
-    status_t setTo(const void* data, size_t size, bool copyData=false);
+    status_t setTo(const void* data, size_t size, bool copyData=false,
+                   uint32_t flags=0);
+
+    // Like setTo(), but memory-maps the file at path read-only instead of
+    // copying it.  The mapping stays open until uninit().  Returns -errno
+    // if the file cannot be opened or mapped.
+    status_t setToFile(const char* path, uint32_t flags=0);
 
     status_t getError() const;
 
+    // Reports why setTo() fails, or why next() returns BAD_DOCUMENT on any
+    // parser of this tree, into diag.  With VALIDATE_ONCE_FLAG, setTo()
+    // can already report the error that next() will stop at.  diag must
+    // outlive the tree and be used by one thread at a time.  NULL turns
+    // reporting off.
+    void setDiagnostics(ResDiagnostics* diag);
+    ResDiagnostics* getDiagnostics() const;
+
     void uninit();
 
+    // Walks the whole document once and records every event, with its
+    // depth and its parent, child, sibling and matching tag links.
+    // Afterwards next() on any parser of this tree steps through the
+    // records without looking at the chunks again, and parsers can seek
+    // to any event or element.  The records reproduce exactly what next()
+    // returns, including a BAD_DOCUMENT at the end of a corrupt document.
+    // Call this before sharing the tree between threads.
+    status_t buildIndex();
+    bool hasIndex() const;
+
+    size_t getEventCount() const;
+    const ResXMLEvent* getEvent(size_t idx) const;
+
+    // Number of START_TAG events and the event index of the Nth one
+    size_t getElementCount() const;
+    ssize_t indexOfElement(size_t n) const;
+
 private:
     friend class ResXMLParser;
 
+    struct ResIdIndex;
+
     status_t validateNode(const ResXMLTree_node* node) const;
+    const ResIdIndex* getResIdIndex() const;
 
     status_t                    mError;
+    ResDiagnostics*             mDiag;
     void*                       mOwnedData;
+    void*                       mMappedData;
+    size_t                      mMappedSize;
     const ResXMLTree_header*    mHeader;
     size_t                      mSize;
     const uint8_t*              mDataEnd;
     ResStringPool               mStrings;
     const uint32_t*             mResIds;
     size_t                      mNumResIds;
+    // Resource ID -> attribute name string index, built by the first
+    // indexOfAttributeByResId() call and freed by uninit()
+    mutable std::atomic<ResIdIndex*> mResIdIndex;
     const ResXMLTree_node*      mRootNode;
     const void*                 mRootExt;
     event_code_t                mRootCode;
+
+    // Set when VALIDATE_ONCE_FLAG found every node to be valid
+    bool                        mValidated;
+
+    // buildIndex() state.  mEventsEnd is the event that follows the last
+    // record: END_DOCUMENT or BAD_DOCUMENT.
+    bool                        mIndexed;
+    std::vector<ResXMLEvent>    mEvents;
+    std::vector<uint32_t>       mElements;
+    event_code_t                mEventsEnd;
+};
+
+/** ********************************************************************
+ *  RESOURCE TABLE
+ *
+ *********************************************************************** */
+
+/**
+ * Header for a resource table.  Its data contains a series of
+ * additional chunks:
+ *   * A ResStringPool_header containing all table values.  This string pool
+ *     contains all of the string values in the entire resource table (not
+ *     the names of entries or type identifiers however).
+ *   * One or more ResTable_package chunks.
+ *
+ * Specific entries within a resource table can be uniquely identified
+ * with a single integer as defined by the ResTable_ref structure.
+ */
+struct ResTable_header
+{
+    struct ResChunk_header header;
+
+    // The number of ResTable_package structures.
+    uint32_t packageCount;
+};
+
+/**
+ * A collection of resource data types within a package.  Followed by
+ * one or more ResTable_type and ResTable_typeSpec structures containing the
+ * entry values for each resource type.
+ */
+struct ResTable_package
+{
+    struct ResChunk_header header;
+
+    // If this is a base package, its ID.  Package IDs start
+    // at 1 (corresponding to the value of the package bits in a
+    // resource identifier).  0 means this is not a base package.
+    uint32_t id;
+
+    // Actual name of this package, \0-terminated.
+    uint16_t name[128];
+
+    // Offset to a ResStringPool_header defining the resource
+    // type symbol table.  If zero, this package is inheriting from
+    // another base package (overriding specific values in it).
+    uint32_t typeStrings;
+
+    // Last index into typeStrings that is for public use by others.
+    uint32_t lastPublicType;
+
+    // Offset to a ResStringPool_header defining the resource
+    // key symbol table.  If zero, this package is inheriting from
+    // another base package (overriding specific values in it).
+    uint32_t keyStrings;
+
+    // Last index into keyStrings that is for public use by others.
+    uint32_t lastPublicKey;
+
+    // Added in Lollipop; older tables have a header that ends before it.
+    uint32_t typeIdOffset;
+};
+
+/**
+ * Describes a particular resource configuration.  Only the size is
+ * interpreted by this library; the rest is kept so that the layout of the
+ * structures that embed it matches the platform's.
+ */
+struct ResTable_config
+{
+    // Number of bytes in this structure.
+    uint32_t size;
+
+    union {
+        struct {
+            // Mobile country code (from SIM).  0 means "any".
+            uint16_t mcc;
+            // Mobile network code (from SIM).  0 means "any".
+            uint16_t mnc;
+        };
+        uint32_t imsi;
+    };
+
+    union {
+        struct {
+            char language[2];
+            char country[2];
+        };
+        uint32_t locale;
+    };
+
+    union {
+        struct {
+            uint8_t orientation;
+            uint8_t touchscreen;
+            uint16_t density;
+        };
+        uint32_t screenType;
+    };
+
+    union {
+        struct {
+            uint8_t keyboard;
+            uint8_t navigation;
+            uint8_t inputFlags;
+            uint8_t inputPad0;
+        };
+        uint32_t input;
+    };
+
+    union {
+        struct {
+            uint16_t screenWidth;
+            uint16_t screenHeight;
+        };
+        uint32_t screenSize;
+    };
+
+    union {
+        struct {
+            uint16_t sdkVersion;
+            // For now minorVersion must always be 0!!!  Its meaning
+            // is currently undefined.
+            uint16_t minorVersion;
+        };
+        uint32_t version;
+    };
+
+    union {
+        struct {
+            uint8_t screenLayout;
+            uint8_t uiMode;
+            uint16_t smallestScreenWidthDp;
+        };
+        uint32_t screenConfig;
+    };
+
+    union {
+        struct {
+            uint16_t screenWidthDp;
+            uint16_t screenHeightDp;
+        };
+        uint32_t screenSizeDp;
+    };
+
+    char localeScript[4];
+    char localeVariant[8];
+};
+
+/**
+ * A specification of the resources defined by a particular type.
+ *
+ * There should be one of these chunks for each resource type.
+ *
+ * This structure is followed by an array of integers providing the set of
+ * configuration change flags (ResTable_config::CONFIG_*) that have multiple
+ * resources for that configuration.  In addition, the high bit is set if that
+ * resource has been made public.
+ */
+struct ResTable_typeSpec
+{
+    struct ResChunk_header header;
+
+    // The type identifier this chunk is holding.  Type IDs start
+    // at 1 (corresponding to the value of the type bits in a
+    // resource identifier).  0 is invalid.
+    uint8_t id;
+
+    // Must be 0.
+    uint8_t res0;
+    // Must be 0.
+    uint16_t res1;
+
+    // Number of uint32_t entry configuration masks that follow.
+    uint32_t entryCount;
+
+    enum {
+        // Additional flag indicating an entry is public.
+        SPEC_PUBLIC = 0x40000000
+    };
+};
+
+/**
+ * A collection of resource entries for a particular resource data
+ * type. Followed by an array of uint32_t defining the resource
+ * values, corresponding to the array of type strings in the
+ * ResTable_package::typeStrings string block. Each of these hold an
+ * index from entriesStart; a value of NO_ENTRY means that entry is
+ * not defined.
+ *
+ * There may be multiple of these chunks for a particular resource type,
+ * supply different configuration variations for the resource values of
+ * that type.
+ */
+struct ResTable_type
+{
+    struct ResChunk_header header;
+
+    enum {
+        NO_ENTRY = 0xFFFFFFFF
+    };
+
+    // The type identifier this chunk is holding.  Type IDs start
+    // at 1 (corresponding to the value of the type bits in a
+    // resource identifier).  0 is invalid.
+    uint8_t id;
+
+    enum {
+        // If set, the entry indices are ResTable_sparseTypeEntry values
+        // sorted by entry index, and only the defined entries are listed.
+        FLAG_SPARSE = 0x01,
+    };
+    uint8_t flags;
+
+    // Must be 0.
+    uint16_t reserved;
+
+    // Number of uint32_t entry indices that follow.
+    uint32_t entryCount;
+
+    // Offset from header where ResTable_entry data starts.
+    uint32_t entriesStart;
+
+    // Configuration this collection of entries is designed for.
+    ResTable_config config;
+};
+
+/**
+ * An entry index in a ResTable_type with FLAG_SPARSE set.
+ */
+struct ResTable_sparseTypeEntry
+{
+    // The index of the entry within its type.
+    uint16_t idx;
+
+    // The offset of the ResTable_entry from entriesStart, divided by 4.
+    uint16_t offset;
+};
+
+/**
+ * This is the beginning of information about an entry in the resource
+ * table.  It holds the reference to the name of this entry, and is
+ * immediately followed by one of:
+ *   * A Res_value structure, if FLAG_COMPLEX is -not- set.
+ *   * An array of ResTable_map structures, if FLAG_COMPLEX is set.
+ *     These supply a set of name/value mappings of data.
+ */
+struct ResTable_entry
+{
+    // Number of bytes in this structure.
+    uint16_t size;
+
+    enum {
+        // If set, this is a complex entry, holding a set of name/value
+        // mappings.  It is followed by an array of ResTable_map structures.
+        FLAG_COMPLEX = 0x0001,
+        // If set, this resource has been declared public, so libraries
+        // are allowed to reference it.
+        FLAG_PUBLIC = 0x0002,
+        // If set, this is a weak resource and may be overriden by strong
+        // resources of the same name/type. This is only useful during
+        // linking with other resource tables.
+        FLAG_WEAK = 0x0004
+    };
+    uint16_t flags;
+
+    // Reference into ResTable_package::keyStrings identifying this entry.
+    struct ResStringPool_ref key;
+};
+
+/**
+ * Extended form of a ResTable_entry for map entries, defining a parent map
+ * resource from which to inherit values.
+ */
+struct ResTable_map_entry : public ResTable_entry
+{
+    // Resource identifier of the parent mapping, or 0 if there is none.
+    // This is always treated as a TYPE_DYNAMIC_REFERENCE.
+    ResTable_ref parent;
+    // Number of name/value pairs that follow for FLAG_COMPLEX.
+    uint32_t count;
+};
+
+/**
+ * A single name/value mapping that is part of a complex resource
+ * entry.
+ */
+struct ResTable_map
+{
+    // The resource identifier defining this mapping's name.  For attribute
+    // resources, 'name' can be one of the following special resource types
+    // to supply meta-data about the attribute; for all other resource types
+    // it must be an attribute resource.
+    ResTable_ref name;
+
+    // This mapping's value.
+    Res_value value;
+};
+
+/**
+ * A package-id to package name mapping for any shared libraries used
+ * in this resource table. The package-id's encoded in this resource
+ * table may be different than the id's assigned at runtime. We must
+ * be able to translate the package-id's based on the package name.
+ */
+struct ResTable_lib_header
+{
+    struct ResChunk_header header;
+
+    // The number of shared libraries linked in this resource table.
+    uint32_t count;
+};
+
+/**
+ * A shared library package-id to package name entry.
+ */
+struct ResTable_lib_entry
+{
+    // The package-id this shared library was assigned at build time.
+    // We use a uint32 to keep the structure aligned on a uint32 boundary.
+    uint32_t packageId;
+
+    // The package name of the shared library. \0 terminated.
+    uint16_t packageName[128];
+};
+
+/**
+ * Convenience class for accessing data in a resources.arsc file.
+ *
+ * Unlike the platform's ResTable, this holds a single table and does not
+ * pick values by configuration.  setTo() validates every chunk once and
+ * indexes the packages, types and entries, so that looking up a resource
+ * ID afterwards is a few array accesses.  The table data is used in place
+ * and must stay valid (unless copyData is set) until uninit().
+ */
+class ResTable
+{
+public:
+    ResTable();
+    ~ResTable();
+
+    status_t setTo(const void* data, size_t size, bool copyData=false);
+
+    // Like setTo(), but memory-maps the file at path read-only.  Returns
+    // -errno if the file cannot be opened or mapped.
+    status_t setToFile(const char* path);
+
+    status_t getError() const;
+
+    void uninit();
+
+    struct resource_name
+    {
+        const char16_t* package;
+        size_t packageLen;
+        const char16_t* type;
+        const char* type8;
+        size_t typeLen;
+        const char16_t* name;
+        const char* name8;
+        size_t nameLen;
+    };
+
+    // Looks up the package, type and entry names of resID.  With allowUtf8,
+    // type8 and name8 are filled in instead of type and name when the
+    // package's pools are UTF-8, which avoids a conversion.
+    bool getResourceName(uint32_t resID, bool allowUtf8,
+                         resource_name* outName) const;
+
+    // Returns the value of resID in the first configuration that defines
+    // it.  Returns BAD_INDEX if there is no such resource and BAD_VALUE if
+    // it is a bag (FLAG_COMPLEX) rather than a simple value.  String values
+    // index getTableStringBlock().
+    status_t getResource(uint32_t resID, Res_value* outValue) const;
+
+    const ResStringPool* getTableStringBlock() const;
+
+    // Package IDs in the order the packages appear in the table.
+    size_t getPackageCount() const;
+    uint32_t getPackageId(size_t idx) const;
+
+    // Highest type ID of a package and number of entries of one of its
+    // types, for iterating over every resource ID; both are 0 if unknown.
+    size_t getTypeCount(uint32_t packageId) const;
+    size_t getEntryCount(uint32_t packageId, uint32_t typeId) const;
+
+private:
+    ResTable(const ResTable&);
+    ResTable& operator=(const ResTable&);
+
+    struct Type;
+    struct Package;
+
+    status_t parsePackage(const ResTable_package* pkg);
+    status_t parseType(Package* package, const ResTable_type* type,
+                       const uint8_t* dataEnd);
+    const ResTable_entry* getEntry(uint32_t resID, const Package** outPackage) const;
+
+    status_t                    mError;
+    void*                       mOwnedData;
+    void*                       mMappedData;
+    size_t                      mMappedSize;
+    const ResTable_header*      mHeader;
+    size_t                      mSize;
+    const uint8_t*              mDataEnd;
+    ResStringPool               mStrings;
+    std::vector<std::unique_ptr<Package>> mPackages;
+    // Indexed by package ID
+    Package*                    mPackageMap[256];
 };
 
 }   // namespace android
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Read-only access to ZIP archives (APKs).
+//
+
+#ifndef _LIBS_ANDROIDFW_ZIPFILERO_H
+#define _LIBS_ANDROIDFW_ZIPFILERO_H
+
+#include <utils/Errors.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+namespace android {
+
+/**
+ * Read-only view of a ZIP archive. The whole file is memory-mapped and the
+ * central directory is indexed once in open(); entry names point straight
+ * into the mapping.
+ *
+ * Only stored and deflated entries are supported. ZIP64 archives and
+ * encrypted entries are rejected.
+ *
+ * All const methods may be called from several threads at once.
+ */
+class ZipFileRO
+{
+public:
+    enum {
+        kCompressStored     = 0,
+        kCompressDeflated   = 8
+    };
+
+    struct Entry
+    {
+        // Not NUL-terminated
+        const char* name;
+        size_t nameLength;
+        uint16_t method;
+        uint32_t crc32;
+        uint32_t compressedSize;
+        uint32_t uncompressedSize;
+        // Offset of the local file header
+        uint32_t localHeaderOffset;
+    };
+
+    ZipFileRO();
+    ~ZipFileRO();
+
+    status_t open(const char* path);
+    void close();
+
+    size_t getNumEntries() const;
+    const Entry* getEntry(size_t idx) const;
+
+    // Returns the index of the entry named name, or a negative error code.
+    ssize_t findEntry(const char* name) const;
+
+    /**
+     * Returns the uncompressed contents of an entry. Stored entries point
+     * directly into the mapped archive. Deflated entries are inflated into
+     * buffer, which is only grown, never shrunk, so that one buffer can be
+     * reused for many entries.
+     */
+    status_t getEntryData(size_t idx, std::vector<uint8_t>* buffer,
+                          const void** outData, size_t* outSize) const;
+
+private:
+    ZipFileRO(const ZipFileRO&);
+    ZipFileRO& operator=(const ZipFileRO&);
+
+    status_t parseCentralDirectory();
+
+    void*               mData;
+    size_t              mSize;
+    std::vector<Entry>  mEntries;
+};
+
+} // namespace android
+
+#endif // _LIBS_ANDROIDFW_ZIPFILERO_H
@@ -16,22 +16,126 @@
 
 #pragma once
 
+#include <atomic>
+
+#include <stddef.h>
 #include <stdio.h>
 
+// Log priorities, with the same values as in liblog
+typedef enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT,
+} android_LogPriority;
+
+// Messages below this priority are compiled out. Their arguments are still
+// type checked, but never evaluated.
+#ifndef AXML_LOG_MIN_PRIORITY
+#define AXML_LOG_MIN_PRIORITY ANDROID_LOG_VERBOSE
+#endif
+
+namespace android {
+
+/**
+ * Receives every message that is not filtered out. msg has no trailing
+ * newline and tag is NULL for messages without a LOG_TAG. Calls are
+ * serialized, so a sink does not need to be thread-safe.
+ */
+typedef void (*LogSink)(void* cookie, int prio, const char* tag,
+                        const char* msg);
+
+// Installs sink for all threads. A NULL sink restores logStderr().
+void setLogSink(LogSink sink, void* cookie = NULL);
+
+// The default sink: prints "[W] <tag>: <msg>" lines to stderr.
+void logStderr(void* cookie, int prio, const char* tag, const char* msg);
+
+// Messages below prio are dropped before they are formatted (default:
+// ANDROID_LOG_VERBOSE, ie. everything that was compiled in).
+void setLogPriority(int prio);
+
+extern std::atomic<int> gLogPriority;
+
+static inline bool isLoggable(int prio)
+{
+    return prio >= gLogPriority.load(std::memory_order_relaxed);
+}
+
+void logPrint(int prio, const char* tag, const char* fmt, ...)
+        __attribute__((format(printf, 3, 4)));
+
+/**
+ * De-duplicates the messages logged by the current thread while the scope
+ * exists, which is meant to be the time spent on one document.  A corrupt
+ * file can otherwise log the same warning for every string or chunk in it.
+ *
+ * Only the first repeatLimit messages from each format string are passed to
+ * the sink.  The others are only counted, without being formatted, and the
+ * counts are logged when the scope ends.
+ *
+ * Scopes nest; the innermost one is used.  Not thread-safe; a scope must be
+ * destroyed by the thread that created it.
+ */
+class LogScope
+{
+public:
+    explicit LogScope(unsigned int repeatLimit = 1);
+    ~LogScope();
+
+    // Number of messages suppressed so far
+    size_t suppressed() const;
+
+private:
+    LogScope(const LogScope&);
+    LogScope& operator=(const LogScope&);
+
+    friend void logPrint(int prio, const char* tag, const char* fmt, ...);
+
+    bool shouldLog(int prio, const char* tag, const char* fmt);
+
+    struct Entry {
+        const char*     fmt;
+        const char*     tag;
+        int             prio;
+        unsigned int    count;
+    };
+
+    // Messages from further format strings are counted in mOthers
+    enum { MAX_ENTRIES = 32 };
+
+    const unsigned int  mRepeatLimit;
+    LogScope*           mPrev;
+    Entry               mEntries[MAX_ENTRIES];
+    size_t              mEntryCount;
+    size_t              mOthers;
+    size_t              mSuppressed;
+};
+
+} // namespace android
+
 #ifdef LOG_TAG
-#define LOG_PREFIX LOG_TAG ": "
+#define ALOG_TAG LOG_TAG
 #else
-#define LOG_PREFIX ""
+#define ALOG_TAG NULL
 #endif
 
-// This is hackish, but good enough. Wo don't really need anything
-// sophisticated (yet).
-#define ALOGD(...) fprintf(stderr, "[D] " LOG_PREFIX __VA_ARGS__)
-#define ALOGE(...) fprintf(stderr, "[E] " LOG_PREFIX __VA_ARGS__)
-#define ALOGI(...) fprintf(stderr, "[I] " LOG_PREFIX __VA_ARGS__)
-#define ALOGV(...) fprintf(stderr, "[V] " LOG_PREFIX __VA_ARGS__)
-#define ALOGW(...) fprintf(stderr, "[W] " LOG_PREFIX __VA_ARGS__)
-#define ALOGF(...) fprintf(stderr, "[FATAL] " LOG_PREFIX __VA_ARGS__)
+#define ALOG(prio, ...) \
+    ((prio) >= AXML_LOG_MIN_PRIORITY && android::isLoggable(prio) \
+        ? android::logPrint(prio, ALOG_TAG, __VA_ARGS__) : (void) 0)
+
+#define ALOGV(...) ALOG(ANDROID_LOG_VERBOSE, __VA_ARGS__)
+#define ALOGD(...) ALOG(ANDROID_LOG_DEBUG, __VA_ARGS__)
+#define ALOGI(...) ALOG(ANDROID_LOG_INFO, __VA_ARGS__)
+#define ALOGW(...) ALOG(ANDROID_LOG_WARN, __VA_ARGS__)
+#define ALOGE(...) ALOG(ANDROID_LOG_ERROR, __VA_ARGS__)
+// Never filtered or de-duplicated
+#define ALOGF(...) android::logPrint(ANDROID_LOG_FATAL, ALOG_TAG, __VA_ARGS__)
 
 #define LOG_ALWAYS_FATAL ALOGF
 
@@ -48,7 +48,14 @@ static inline uint16_t android_swap_short(uint16_t v)
     return (v<<8) | (v>>8);
 }
 
+/*
+ * Can be overridden on the command line to build a little-endian host as if
+ * it were big-endian (and vice versa), so that the swapping paths can be
+ * exercised with byte-swapped data.
+ */
+#ifndef DEVICE_BYTE_ORDER
 #define DEVICE_BYTE_ORDER LITTLE_ENDIAN
+#endif
 
 #if BYTE_ORDER == DEVICE_BYTE_ORDER
 
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_STRING_ARENA_H
+#define ANDROID_STRING_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+
+/**
+ * Scratch allocator for short-lived UTF-8 strings.  Strings are carved out
+ * of large blocks and are all released at once by reset(), instead of each
+ * one costing a SharedBuffer allocation and atomic reference counting as a
+ * String8 does.  Meant to be reset once per document.
+ *
+ * A string can be built piece by piece with begin(), append*() and finish().
+ * No other string may be allocated while one is being built.
+ *
+ * If memory runs out, the affected strings come back empty.
+ *
+ * Not thread-safe; use one arena per thread.
+ */
+class StringArena
+{
+public:
+    explicit StringArena(size_t blockSize = 16384);
+    ~StringArena();
+
+    // Returns a NUL-terminated copy of len bytes of s.
+    const char* dup(const char* s, size_t len);
+
+    // Returns s converted to UTF-8 the way String8(const char16_t*) does it:
+    // the string ends at the first NUL and a NULL string is empty.
+    const char* toUTF8(const char16_t* s, size_t len, size_t* outLen = NULL);
+
+    void begin();
+    void append(const char* s, size_t len);
+    void appendUTF8(const char16_t* s, size_t len);
+    // Returns the NUL-terminated string built since begin().
+    const char* finish(size_t* outLen = NULL);
+
+    // Releases every string.  If the last document did not fit in one
+    // block, the blocks are replaced by a single one large enough for it,
+    // so that the same amount of data will not need any allocation next
+    // time.
+    void reset();
+
+    // Bytes handed out since the last reset()
+    size_t bytesUsed() const;
+
+private:
+    StringArena(const StringArena&);
+    StringArena& operator=(const StringArena&);
+
+    struct Block;
+
+    bool reserve(size_t size);
+
+    const size_t    mBlockSize;
+    // Block being filled; earlier blocks are reachable through its next
+    Block*          mBlock;
+    size_t          mUsed;
+    // Bytes used in the blocks before mBlock
+    size_t          mFull;
+    // Offset in mBlock of the string being built
+    size_t          mStart;
+    bool            mFailed;
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_STRING_ARENA_H
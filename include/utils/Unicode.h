@@ -166,6 +166,30 @@ char16_t* utf8_to_utf16_no_null_terminator(const uint8_t* src, size_t srcLen, ch
  */
 void utf8_to_utf16(const uint8_t* src, size_t srcLen, char16_t* dst);
 
+/**
+ * Implementations of the ASCII fast paths in utf8_to_utf16_length,
+ * utf8_to_utf16, utf16_to_utf8_length and utf16_to_utf8. By default the
+ * best kernel the CPU supports is picked at startup; the scalar code is
+ * used where no vector kernel is available.
+ */
+enum {
+    UTF_KERNEL_AUTO = 0,
+    UTF_KERNEL_SCALAR = 1,
+    UTF_KERNEL_SSE2 = 2,
+    UTF_KERNEL_AVX2 = 3
+};
+
+/**
+ * Selects the kernel used by subsequent conversions, mainly for benchmarks.
+ * Returns 0 on success or -1 if the CPU does not support "kernel".
+ */
+int utf_select_kernel(int kernel);
+
+/**
+ * Returns the kernel currently in use. Never returns UTF_KERNEL_AUTO.
+ */
+int utf_current_kernel(void);
+
 /**
  * Like utf8_to_utf16_no_null_terminator, but you can supply a maximum length of the
  * decoded string.  The decoded string will fill up to that length; if it is longer
@@ -173,6 +197,14 @@ void utf8_to_utf16(const uint8_t* src, size_t srcLen, char16_t* dst);
  */
 char16_t* utf8_to_utf16_n(const uint8_t* src, size_t srcLen, char16_t* dst, size_t dstLen);
 
+/**
+ * Compares the UTF-8 string s1 (n1 bytes) with the UTF-16 string s2 (n2
+ * units) exactly like strzcmp16() would compare the UTF-16 conversion of
+ * s1 with s2, but decodes s1 as it goes instead of converting it into a
+ * buffer first.
+ */
+int strzcmp16_utf8(const uint8_t* s1, size_t n1, const char16_t* s2, size_t n2);
+
 }
 
 #endif
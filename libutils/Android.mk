@@ -17,10 +17,12 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
+	Logging.cpp \
 	SharedBuffer.cpp \
 	Static.cpp \
 	String8.cpp \
 	String16.cpp \
+	StringArena.cpp \
 	Timers.cpp \
 	Unicode.cpp
 
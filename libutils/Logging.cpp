@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <logging.h>
+
+#include <mutex>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace android {
+
+std::atomic<int> gLogPriority(ANDROID_LOG_VERBOSE);
+
+// Guards the sink and serializes the calls to it
+static std::mutex gSinkLock;
+static LogSink gSink = logStderr;
+static void* gSinkCookie = NULL;
+
+static thread_local LogScope* tScope = NULL;
+
+static void emit(int prio, const char* tag, const char* msg)
+{
+    std::lock_guard<std::mutex> lock(gSinkLock);
+    gSink(gSinkCookie, prio, tag, msg);
+}
+
+void setLogSink(LogSink sink, void* cookie)
+{
+    std::lock_guard<std::mutex> lock(gSinkLock);
+    gSink = sink ? sink : logStderr;
+    gSinkCookie = sink ? cookie : NULL;
+}
+
+void logStderr(void* /* cookie */, int prio, const char* tag, const char* msg)
+{
+    const char* level;
+    switch (prio) {
+    case ANDROID_LOG_VERBOSE: level = "V";     break;
+    case ANDROID_LOG_DEBUG:   level = "D";     break;
+    case ANDROID_LOG_INFO:    level = "I";     break;
+    case ANDROID_LOG_WARN:    level = "W";     break;
+    case ANDROID_LOG_ERROR:   level = "E";     break;
+    case ANDROID_LOG_FATAL:   level = "FATAL"; break;
+    default:                  level = "?";     break;
+    }
+
+    if (tag) {
+        fprintf(stderr, "[%s] %s: %s\n", level, tag, msg);
+    } else {
+        fprintf(stderr, "[%s] %s\n", level, msg);
+    }
+}
+
+void setLogPriority(int prio)
+{
+    gLogPriority.store(prio, std::memory_order_relaxed);
+}
+
+void logPrint(int prio, const char* tag, const char* fmt, ...)
+{
+    LogScope* scope = tScope;
+    if (scope && prio < ANDROID_LOG_FATAL && !scope->shouldLog(prio, tag, fmt)) {
+        return;
+    }
+
+    char buf[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return;
+    }
+
+    // Most messages end with a newline, some do not
+    size_t len = strlen(buf);
+    while (len > 0 && buf[len - 1] == '\n') {
+        buf[--len] = '\0';
+    }
+
+    emit(prio, tag, buf);
+}
+
+LogScope::LogScope(unsigned int repeatLimit)
+    : mRepeatLimit(repeatLimit), mPrev(tScope), mEntryCount(0), mOthers(0)
+    , mSuppressed(0)
+{
+    tScope = this;
+}
+
+LogScope::~LogScope()
+{
+    tScope = mPrev;
+
+    // Sent to the sink directly so that an outer scope does not merge the
+    // counts of different messages
+    char buf[1024];
+    for (size_t i = 0; i < mEntryCount; ++i) {
+        const Entry& e = mEntries[i];
+        if (e.count <= mRepeatLimit) {
+            continue;
+        }
+        size_t len = strlen(e.fmt);
+        while (len > 0 && e.fmt[len - 1] == '\n') {
+            --len;
+        }
+        snprintf(buf, sizeof(buf), "Suppressed %u more: %.*s",
+                 e.count - mRepeatLimit, (int) len, e.fmt);
+        emit(e.prio, e.tag, buf);
+    }
+    if (mOthers > 0) {
+        snprintf(buf, sizeof(buf), "Suppressed %zu more messages", mOthers);
+        emit(ANDROID_LOG_WARN, NULL, buf);
+    }
+}
+
+size_t LogScope::suppressed() const
+{
+    return mSuppressed;
+}
+
+bool LogScope::shouldLog(int prio, const char* tag, const char* fmt)
+{
+    // The format string identifies the message. Pointer comparison is
+    // enough: every message comes from a literal at its call site.
+    for (size_t i = 0; i < mEntryCount; ++i) {
+        Entry& e = mEntries[i];
+        if (e.fmt == fmt && e.tag == tag) {
+            if (++e.count <= mRepeatLimit) {
+                return true;
+            }
+            ++mSuppressed;
+            return false;
+        }
+    }
+
+    if (mEntryCount < MAX_ENTRIES) {
+        Entry& e = mEntries[mEntryCount++];
+        e.fmt = fmt;
+        e.tag = tag;
+        e.prio = prio;
+        e.count = 1;
+        if (e.count <= mRepeatLimit) {
+            return true;
+        }
+    } else {
+        ++mOthers;
+    }
+    ++mSuppressed;
+    return false;
+}
+
+} // namespace android
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/StringArena.h>
+#include <utils/Unicode.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+
+struct StringArena::Block
+{
+    Block*  next;
+    size_t  size;
+
+    char* data() { return (char*) (this + 1); }
+};
+
+StringArena::StringArena(size_t blockSize)
+    : mBlockSize(blockSize), mBlock(NULL), mUsed(0), mFull(0), mStart(0),
+      mFailed(false)
+{
+}
+
+StringArena::~StringArena()
+{
+    while (mBlock != NULL) {
+        Block* next = mBlock->next;
+        free(mBlock);
+        mBlock = next;
+    }
+}
+
+// Makes room for size more bytes at mUsed. The part of the string being built
+// that is already in the arena moves along to a new block if one is needed.
+bool StringArena::reserve(size_t size)
+{
+    if (mBlock != NULL && mBlock->size - mUsed >= size) {
+        return true;
+    }
+
+    const size_t partial = mUsed - mStart;
+    size_t blockSize = mBlockSize;
+    if (partial + size > blockSize) {
+        blockSize = partial + size;
+    }
+    Block* block = (Block*) malloc(sizeof(Block) + blockSize);
+    if (block == NULL) {
+        return false;
+    }
+    block->next = mBlock;
+    block->size = blockSize;
+
+    if (partial > 0) {
+        memcpy(block->data(), mBlock->data() + mStart, partial);
+    }
+    mFull += mStart;
+    mBlock = block;
+    mStart = 0;
+    mUsed = partial;
+    return true;
+}
+
+const char* StringArena::dup(const char* s, size_t len)
+{
+    begin();
+    append(s, len);
+    return finish();
+}
+
+const char* StringArena::toUTF8(const char16_t* s, size_t len, size_t* outLen)
+{
+    begin();
+    appendUTF8(s, len);
+    return finish(outLen);
+}
+
+void StringArena::begin()
+{
+    mStart = mUsed;
+    mFailed = false;
+}
+
+void StringArena::append(const char* s, size_t len)
+{
+    if (mFailed || len == 0) {
+        return;
+    }
+    if (!reserve(len)) {
+        mFailed = true;
+        return;
+    }
+    memcpy(mBlock->data() + mUsed, s, len);
+    mUsed += len;
+}
+
+void StringArena::appendUTF8(const char16_t* s, size_t len)
+{
+    if (mFailed || s == NULL) {
+        return;
+    }
+    len = strnlen16(s, len);
+    const ssize_t n = utf16_to_utf8_length(s, len);
+    if (n <= 0) {
+        return;
+    }
+    // utf16_to_utf8() also writes a terminator
+    if (!reserve(n + 1)) {
+        mFailed = true;
+        return;
+    }
+    utf16_to_utf8(s, len, mBlock->data() + mUsed);
+    mUsed += n;
+}
+
+const char* StringArena::finish(size_t* outLen)
+{
+    const char* str = "";
+    size_t len = 0;
+    if (!mFailed && reserve(1)) {
+        str = mBlock->data() + mStart;
+        len = mUsed - mStart;
+        mBlock->data()[mUsed++] = '\0';
+    } else {
+        mUsed = mStart;
+    }
+    mStart = mUsed;
+    mFailed = false;
+    if (outLen) {
+        *outLen = len;
+    }
+    return str;
+}
+
+void StringArena::reset()
+{
+    if (mBlock != NULL && mBlock->next != NULL) {
+        size_t size = mFull + mUsed;
+        if (size < mBlockSize) {
+            size = mBlockSize;
+        }
+        while (mBlock != NULL) {
+            Block* next = mBlock->next;
+            free(mBlock);
+            mBlock = next;
+        }
+        Block* block = (Block*) malloc(sizeof(Block) + size);
+        if (block != NULL) {
+            block->next = NULL;
+            block->size = size;
+            mBlock = block;
+        }
+    }
+    mUsed = 0;
+    mFull = 0;
+    mStart = 0;
+    mFailed = false;
+}
+
+size_t StringArena::bytesUsed() const
+{
+    return mFull + mUsed;
+}
+
+}; // namespace android
@@ -16,7 +16,16 @@
 
 #include <utils/Unicode.h>
 
+#include <atomic>
+
 #include <stddef.h>
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define HAVE_X86_UTF_KERNELS 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
 
 #ifdef HAVE_WINSOCK
 # undef  nhtol
@@ -68,6 +77,216 @@ static const char32_t kFirstByteMark[] = {
     0x00000000, 0x00000000, 0x000000C0, 0x000000E0, 0x000000F0
 };
 
+// --------------------------------------------------------------------------
+// ASCII fast paths
+// --------------------------------------------------------------------------
+
+// Each kernel handles the leading run of ASCII code units of its input in
+// whole blocks and returns how many units it consumed; 0 means the first
+// block was not all ASCII (or the input is shorter than a block). The
+// callers only invoke them on a character boundary and continue with the
+// scalar code, so the validation behaviour is exactly that of the scalar
+// loops.
+struct utf_kernels {
+    int id;
+    // Minimum number of units a kernel needs to make progress.
+    size_t block;
+    size_t (*ascii_run8)(const uint8_t* src, size_t len);
+    size_t (*widen)(const uint8_t* src, size_t len, char16_t* dst);
+    size_t (*ascii_run16)(const char16_t* src, size_t len);
+    size_t (*narrow)(const char16_t* src, size_t len, char* dst);
+};
+
+#ifdef HAVE_X86_UTF_KERNELS
+
+static inline size_t ascii_run8_sse2(const uint8_t* src, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        if (_mm_movemask_epi8(v) != 0) {
+            break;
+        }
+    }
+    return i;
+}
+
+static inline size_t widen_sse2(const uint8_t* src, size_t len, char16_t* dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        if (_mm_movemask_epi8(v) != 0) {
+            break;
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+    return i;
+}
+
+static inline size_t ascii_run16_sse2(const char16_t* src, size_t len)
+{
+    const __m128i mask = _mm_set1_epi16((short)0xFF80);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        const __m128i high = _mm_and_si128(v, mask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF) {
+            break;
+        }
+    }
+    return i;
+}
+
+static inline size_t narrow_sse2(const char16_t* src, size_t len, char* dst)
+{
+    const __m128i mask = _mm_set1_epi16((short)0xFF80);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 8));
+        const __m128i high = _mm_and_si128(_mm_or_si128(a, b), mask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF) {
+            break;
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(a, b));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t ascii_run8_avx2(const uint8_t* src, size_t len)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        if (_mm256_movemask_epi8(v) != 0) {
+            break;
+        }
+    }
+    // Finish a shorter tail (or the ASCII half of the last block) in
+    // 16-byte steps.
+    return i + ascii_run8_sse2(src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t widen_avx2(const uint8_t* src, size_t len, char16_t* dst)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        if (_mm256_movemask_epi8(v) != 0) {
+            break;
+        }
+        _mm256_storeu_si256((__m256i*)(dst + i),
+                _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+        _mm256_storeu_si256((__m256i*)(dst + i + 16),
+                _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+    }
+    // Finish a shorter tail (or the ASCII half of the last block) in
+    // 16-byte steps.
+    return i + widen_sse2(src + i, len - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static size_t ascii_run16_avx2(const char16_t* src, size_t len)
+{
+    const __m256i mask = _mm256_set1_epi16((short)0xFF80);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        if (!_mm256_testz_si256(v, mask)) {
+            break;
+        }
+    }
+    // Finish a shorter tail (or the ASCII half of the last block) in
+    // 16-byte steps.
+    return i + ascii_run16_sse2(src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t narrow_avx2(const char16_t* src, size_t len, char* dst)
+{
+    const __m256i mask = _mm256_set1_epi16((short)0xFF80);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 16));
+        if (!_mm256_testz_si256(_mm256_or_si256(a, b), mask)) {
+            break;
+        }
+        // packus works within 128-bit lanes; put the quadwords back in order.
+        const __m256i packed = _mm256_permute4x64_epi64(
+                _mm256_packus_epi16(a, b), 0xD8);
+        _mm256_storeu_si256((__m256i*)(dst + i), packed);
+    }
+    // Finish a shorter tail (or the ASCII half of the last block) in
+    // 16-byte steps.
+    return i + narrow_sse2(src + i, len - i, dst + i);
+}
+
+static const utf_kernels kSse2Kernels = {
+    UTF_KERNEL_SSE2, 16, ascii_run8_sse2, widen_sse2, ascii_run16_sse2, narrow_sse2
+};
+
+static const utf_kernels kAvx2Kernels = {
+    UTF_KERNEL_AVX2, 32, ascii_run8_avx2, widen_avx2, ascii_run16_avx2, narrow_avx2
+};
+
+#endif // HAVE_X86_UTF_KERNELS
+
+static const utf_kernels* utf_kernels_for(int kernel)
+{
+#ifdef HAVE_X86_UTF_KERNELS
+    __builtin_cpu_init();
+    switch (kernel) {
+        case UTF_KERNEL_AUTO:
+            if (__builtin_cpu_supports("avx2")) {
+                return &kAvx2Kernels;
+            }
+            if (__builtin_cpu_supports("sse2")) {
+                return &kSse2Kernels;
+            }
+            return NULL;
+        case UTF_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2") ? &kAvx2Kernels : NULL;
+        case UTF_KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2") ? &kSse2Kernels : NULL;
+    }
+#else
+    (void) kernel;
+#endif
+    return NULL;
+}
+
+// NULL selects the plain scalar loops.
+static std::atomic<const utf_kernels*> gUtfKernels(utf_kernels_for(UTF_KERNEL_AUTO));
+
+static inline const utf_kernels* utf_kernels_get()
+{
+    return gUtfKernels.load(std::memory_order_relaxed);
+}
+
+int utf_select_kernel(int kernel)
+{
+    const utf_kernels* k = utf_kernels_for(kernel);
+    if (k == NULL && kernel != UTF_KERNEL_SCALAR && kernel != UTF_KERNEL_AUTO) {
+        return -1;
+    }
+    gUtfKernels.store(k, std::memory_order_relaxed);
+    return 0;
+}
+
+int utf_current_kernel(void)
+{
+    const utf_kernels* k = utf_kernels_get();
+    return k != NULL ? k->id : UTF_KERNEL_SCALAR;
+}
+
 // --------------------------------------------------------------------------
 // UTF-32
 // --------------------------------------------------------------------------
@@ -336,10 +555,20 @@ void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst)
         return;
     }
 
+    const utf_kernels* k = utf_kernels_get();
+    const bool simd = k != NULL && src_len >= k->block;
     const char16_t* cur_utf16 = src;
     const char16_t* const end_utf16 = src + src_len;
+    const char16_t* next_simd = src;
     char *cur = dst;
     while (cur_utf16 < end_utf16) {
+        if (simd && *cur_utf16 < 0x80 && cur_utf16 >= next_simd) {
+            const size_t n = k->narrow(cur_utf16, end_utf16 - cur_utf16, cur);
+            cur_utf16 += n;
+            cur += n;
+            next_simd = cur_utf16 + k->block;
+            continue;
+        }
         char32_t utf32;
         // surrogate pairs
         if((*cur_utf16 & 0xFC00) == 0xD800 && (cur_utf16 + 1) < end_utf16
@@ -410,9 +639,19 @@ ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len)
         return -1;
     }
 
+    const utf_kernels* k = utf_kernels_get();
+    const bool simd = k != NULL && src_len >= k->block;
     size_t ret = 0;
     const char16_t* const end = src + src_len;
+    const char16_t* next_simd = src;
     while (src < end) {
+        if (simd && *src < 0x80 && src >= next_simd) {
+            const size_t n = k->ascii_run16(src, end - src);
+            src += n;
+            ret += n;
+            next_simd = src + k->block;
+            continue;
+        }
         if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
                 && (*++src & 0xFC00) == 0xDC00) {
             // surrogate pairs are always 4 bytes.
@@ -519,14 +758,28 @@ static inline uint32_t utf8_to_utf32_codepoint(const uint8_t *src, size_t length
 
 ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len)
 {
+    const utf_kernels* k = utf_kernels_get();
+    const bool simd = k != NULL && u8len >= k->block;
     const uint8_t* const u8end = u8str + u8len;
     const uint8_t* u8cur = u8str;
+    const uint8_t* next_simd = u8str;
 
     /* Validate that the UTF-8 is the correct len */
     size_t u16measuredLen = 0;
     while (u8cur < u8end) {
+        if (simd && *u8cur < 0x80 && u8cur >= next_simd) {
+            const size_t n = k->ascii_run8(u8cur, u8end - u8cur);
+            u8cur += n;
+            u16measuredLen += n;
+            next_simd = u8cur + k->block;
+            continue;
+        }
         u16measuredLen++;
         int u8charLen = utf8_codepoint_len(*u8cur);
+        // A sequence cut short by the end could only end past it below
+        if (u8charLen > u8end - u8cur) {
+            return -1;
+        }
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8charLen);
         if (codepoint > 0xFFFF) u16measuredLen++; // this will be a surrogate pair in utf16
         u8cur += u8charLen;
@@ -545,11 +798,21 @@ ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len)
 
 char16_t* utf8_to_utf16_no_null_terminator(const uint8_t* u8str, size_t u8len, char16_t* u16str)
 {
+    const utf_kernels* k = utf_kernels_get();
+    const bool simd = k != NULL && u8len >= k->block;
     const uint8_t* const u8end = u8str + u8len;
     const uint8_t* u8cur = u8str;
+    const uint8_t* next_simd = u8str;
     char16_t* u16cur = u16str;
 
     while (u8cur < u8end) {
+        if (simd && *u8cur < 0x80 && u8cur >= next_simd) {
+            const size_t n = k->widen(u8cur, u8end - u8cur, u16cur);
+            u8cur += n;
+            u16cur += n;
+            next_simd = u8cur + k->block;
+            continue;
+        }
         size_t u8len = utf8_codepoint_len(*u8cur);
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8len);
 
@@ -604,4 +867,50 @@ char16_t* utf8_to_utf16_n(const uint8_t* src, size_t srcLen, char16_t* dst, size
     return u16cur;
 }
 
+int strzcmp16_utf8(const uint8_t* s1, size_t n1, const char16_t* s2, size_t n2)
+{
+    const uint8_t* const e1 = s1 + n1;
+    const char16_t* const e2 = s2 + n2;
+    // Low surrogate still to be compared after a supplementary character
+    char16_t pending = 0;
+    bool hasPending = false;
+
+    for (;;) {
+        char16_t c1;
+        if (hasPending) {
+            c1 = pending;
+            hasPending = false;
+        } else if (s1 < e1) {
+            // A sequence cut short by the end of the string is completed
+            // with zeros, as if it ran into the pool's NUL terminator.
+            const size_t u8len = utf8_codepoint_len(*s1);
+            uint8_t buf[4] = { 0, 0, 0, 0 };
+            const size_t avail = (size_t) (e1 - s1);
+            memcpy(buf, s1, u8len < avail ? u8len : avail);
+            uint32_t codepoint = utf8_to_utf32_codepoint(buf, u8len);
+            s1 += u8len < avail ? u8len : avail;
+
+            if (codepoint <= 0xFFFF) {
+                c1 = (char16_t) codepoint;
+            } else {
+                codepoint = codepoint - 0x10000;
+                c1 = (char16_t) ((codepoint >> 10) + 0xD800);
+                pending = (char16_t) ((codepoint & 0x3FF) + 0xDC00);
+                hasPending = true;
+            }
+        } else {
+            // s1 ended: equal if s2 did too, otherwise like strzcmp16()
+            return s2 < e2 ? 0 - (int) *s2 : 0;
+        }
+
+        if (s2 == e2) {
+            return (int) c1 - 0;
+        }
+        const int d = (int) c1 - (int) *s2++;
+        if (d) {
+            return d;
+        }
+    }
+}
+
 }
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Minimal checks for the tests in this directory. Each test is a program
+// that takes the path of tests/data as its only argument and exits with a
+// non-zero status if any check failed.
+
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+static int g_failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: Check failed: %s\n", \
+                    __FILE__, __LINE__, #cond); \
+            ++g_failures; \
+        } \
+    } while (0)
+
+// Exit status of a test
+static inline int test_result()
+{
+    return g_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Generates the resource tables in table/ that table_test reads. Each has a
+# single package 0x7f, com.example.app:
+#
+#   type_id_offset.arsc  typeIdOffset 2, so its types are 3 (layout) and
+#                        4 (string)
+#   bad_type_id.arsc     typeIdOffset 2 and a type spec with id 2
+#   sparse.arsc          string entries 0-5 with a dense default
+#                        configuration defining 0 and 1 and a sparse one
+#                        defining 1 and 5
+#   unknown_flags.arsc   a string type chunk with flags 0x02 ahead of a
+#                        readable one
+#   bad_entries.arsc     string entries with an offset past the chunk, a
+#                        misaligned offset, a bad size and a bad key index,
+#                        followed by a valid one
+
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from gen_axml import string_pool
+
+RES_TABLE_TYPE = 0x0002
+RES_TABLE_PACKAGE_TYPE = 0x0200
+RES_TABLE_TYPE_TYPE = 0x0201
+RES_TABLE_TYPE_SPEC_TYPE = 0x0202
+
+FLAG_SPARSE = 0x01
+NO_ENTRY = 0xffffffff
+
+TYPE_STRING = 0x03
+TYPE_INT_DEC = 0x10
+
+CONFIG_SIZE = 64
+
+
+def chunk(chunk_type, header, body):
+    header_size = 8 + len(header)
+    return struct.pack('<HHI', chunk_type, header_size,
+                       header_size + len(body)) + header + body
+
+
+def entry(key, data_type, data):
+    return struct.pack('<HHI', 8, 0, key) + \
+            struct.pack('<HBBI', 8, 0, data_type, data)
+
+
+def type_spec(type_id, count):
+    return chunk(RES_TABLE_TYPE_SPEC_TYPE,
+                 struct.pack('<BBHI', type_id, 0, 0, count),
+                 b'\0' * (4 * count))
+
+
+def type_chunk(type_id, entries, flags=0, offsets=None):
+    """entries maps entry indices to entry data. The index is dense (one
+    offset per entry up to the highest index) unless flags has FLAG_SPARSE.
+    offsets overrides the offsets of some entries."""
+    data = b''
+    index = []
+    for i in sorted(entries):
+        index.append((i, len(data)))
+        data += entries[i]
+    if offsets:
+        index = [(i, offsets.get(i, o)) for i, o in index]
+
+    if flags & FLAG_SPARSE:
+        table = b''.join(struct.pack('<HH', i, o // 4) for i, o in index)
+        count = len(index)
+    else:
+        count = max(entries) + 1
+        dense = [NO_ENTRY] * count
+        for i, o in index:
+            dense[i] = o
+        table = b''.join(struct.pack('<I', o) for o in dense)
+
+    config = struct.pack('<I', CONFIG_SIZE) + b'\0' * (CONFIG_SIZE - 4)
+    entries_start = 8 + 12 + len(config) + len(table)
+    return chunk(RES_TABLE_TYPE_TYPE,
+                 struct.pack('<BBHII', type_id, flags, 0, count,
+                             entries_start) + config,
+                 table + data)
+
+
+def package(types, keys, body, type_id_offset=0):
+    type_pool = string_pool(types, True)
+    key_pool = string_pool(keys, True)
+    name = 'com.example.app'.encode('utf-16-le').ljust(256, b'\0')
+    header_size = 288
+    header = struct.pack('<I', 0x7f) + name + struct.pack(
+            '<IIIII', header_size, len(types), header_size + len(type_pool),
+            len(keys), type_id_offset)
+    return chunk(RES_TABLE_PACKAGE_TYPE, header, type_pool + key_pool + body)
+
+
+def table(values, pkg):
+    return chunk(RES_TABLE_TYPE, struct.pack('<I', 1),
+                 string_pool(values, True) + pkg)
+
+
+VALUES = ['Hello', 'World']
+KEYS = ['main', 'hello', 'world', 'sparse']
+
+
+def type_id_offset():
+    return table(VALUES, package(['layout', 'string'], KEYS,
+        type_spec(3, 1)
+        + type_chunk(3, {0: entry(0, TYPE_STRING, 0)})
+        + type_spec(4, 2)
+        + type_chunk(4, {0: entry(1, TYPE_STRING, 0),
+                         1: entry(2, TYPE_STRING, 1)}),
+        type_id_offset=2))
+
+
+def bad_type_id():
+    return table(VALUES, package(['layout', 'string'], KEYS,
+        type_spec(2, 1)
+        + type_chunk(2, {0: entry(0, TYPE_STRING, 0)}),
+        type_id_offset=2))
+
+
+def sparse():
+    return table(VALUES, package(['string'], KEYS,
+        type_spec(1, 6)
+        + type_chunk(1, {0: entry(1, TYPE_STRING, 0),
+                         1: entry(2, TYPE_STRING, 1)})
+        + type_chunk(1, {1: entry(2, TYPE_INT_DEC, 1),
+                         5: entry(3, TYPE_INT_DEC, 5)}, flags=FLAG_SPARSE)))
+
+
+def unknown_flags():
+    return table(VALUES, package(['string'], KEYS,
+        type_spec(1, 1)
+        + type_chunk(1, {0: entry(1, TYPE_INT_DEC, 2)}, flags=0x02)
+        + type_chunk(1, {0: entry(1, TYPE_STRING, 0)})))
+
+
+def bad_entries():
+    bad_size = struct.pack('<HHI', 0x100, 0, 1) + \
+            struct.pack('<HBBI', 8, 0, TYPE_INT_DEC, 2)
+    return table(VALUES, package(['string'], KEYS,
+        type_spec(1, 5)
+        + type_chunk(1, {0: entry(1, TYPE_INT_DEC, 0),
+                         1: entry(1, TYPE_INT_DEC, 1),
+                         2: bad_size,
+                         3: entry(len(KEYS), TYPE_INT_DEC, 3),
+                         4: entry(2, TYPE_INT_DEC, 4)},
+                     offsets={0: 0x1000, 1: 2})))
+
+
+def main():
+    out = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'table')
+    os.makedirs(out, exist_ok=True)
+    for name, build in [('type_id_offset', type_id_offset),
+                        ('bad_type_id', bad_type_id),
+                        ('sparse', sparse),
+                        ('unknown_flags', unknown_flags),
+                        ('bad_entries', bad_entries)]:
+        with open(os.path.join(out, name + '.arsc'), 'wb') as f:
+            f.write(build())
+
+
+if __name__ == '__main__':
+    main()
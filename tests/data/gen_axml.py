@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Generates the little-endian binary XML files that the tests read:
+#
+#   endian/utf8.axml, endian/utf16.axml
+#       a manifest using most attribute types, with UTF-8 and UTF-16 string
+#       pools (swap_axml.py makes the .be.axml copies)
+#   printer/*.axml
+#       documents with nodes outside of the root element, for printer_test
+#
+# Usage: gen_axml.py [<data directory>]
+
+import os
+import struct
+import sys
+
+RES_STRING_POOL_TYPE = 0x0001
+RES_XML_TYPE = 0x0003
+RES_XML_START_NAMESPACE_TYPE = 0x0100
+RES_XML_END_NAMESPACE_TYPE = 0x0101
+RES_XML_START_ELEMENT_TYPE = 0x0102
+RES_XML_END_ELEMENT_TYPE = 0x0103
+RES_XML_CDATA_TYPE = 0x0104
+RES_XML_RESOURCE_MAP_TYPE = 0x0180
+
+UTF8_FLAG = 0x100
+NO_INDEX = 0xffffffff
+
+TYPE_NULL = 0x00
+TYPE_REFERENCE = 0x01
+TYPE_ATTRIBUTE = 0x02
+TYPE_STRING = 0x03
+TYPE_FLOAT = 0x04
+TYPE_DIMENSION = 0x05
+TYPE_FRACTION = 0x06
+TYPE_DYNAMIC_REFERENCE = 0x07
+TYPE_INT_DEC = 0x10
+TYPE_INT_HEX = 0x11
+TYPE_INT_BOOLEAN = 0x12
+TYPE_INT_COLOR_ARGB8 = 0x1c
+
+ANDROID = 'http://schemas.android.com/apk/res/android'
+APP = 'http://schemas.android.com/apk/res-auto'
+
+
+def len8(n):
+    if n > 0x7f:
+        return bytes([0x80 | (n >> 8), n & 0xff])
+    return bytes([n])
+
+
+def len16(n):
+    if n > 0x7fff:
+        return struct.pack('<HH', 0x8000 | (n >> 16), n & 0xffff)
+    return struct.pack('<H', n)
+
+
+def string_pool(strings, utf8):
+    data = b''
+    offsets = []
+    for s in strings:
+        offsets.append(len(data))
+        if utf8:
+            b = s.encode('utf-8', 'surrogatepass')
+            u16 = len(s.encode('utf-16-le', 'surrogatepass')) // 2
+            data += len8(u16) + len8(len(b)) + b + b'\0'
+        else:
+            b = s.encode('utf-16-le', 'surrogatepass')
+            data += len16(len(b) // 2) + b + b'\0\0'
+    while len(data) % 4:
+        data += b'\0'
+
+    header_size = 28
+    body = b''.join(struct.pack('<I', o) for o in offsets) + data
+    return struct.pack('<HHIIIIII', RES_STRING_POOL_TYPE, header_size,
+                       header_size + len(body), len(strings), 0,
+                       UTF8_FLAG if utf8 else 0,
+                       header_size + 4 * len(strings), 0) + body
+
+
+class Strings:
+    def __init__(self):
+        self.strings = []
+        self.res_ids = []
+
+    def index(self, s):
+        if s is None:
+            return NO_INDEX
+        if s not in self.strings:
+            self.strings.append(s)
+        return self.strings.index(s)
+
+    def attr_name(self, name, res_id):
+        # Names with a resource ID come first, in the resource map's order
+        if name not in self.strings:
+            self.strings.insert(len(self.res_ids), name)
+            self.res_ids.append(res_id)
+        return self.strings.index(name)
+
+
+def build(events, utf8):
+    """Builds a binary XML file from a list of events:
+
+    ('ns', prefix, uri)
+    ('endns', prefix, uri)
+    ('start', ns, name, [(ns, name, res_id, raw, type, data)...], comment)
+    ('end', ns, name)
+    ('text', text)
+    """
+    pool = Strings()
+
+    # Attribute names with resource IDs go at the front of the pool, so add
+    # them before any index is handed out
+    for e in events:
+        if e[0] == 'start':
+            for a in e[3]:
+                if a[2]:
+                    pool.attr_name(a[1], a[2])
+
+    nodes = b''
+    for line, e in enumerate(events, 1):
+        comment = NO_INDEX
+        if e[0] in ('ns', 'endns'):
+            node_type = RES_XML_START_NAMESPACE_TYPE if e[0] == 'ns' \
+                    else RES_XML_END_NAMESPACE_TYPE
+            ext = struct.pack('<II', pool.index(e[1]), pool.index(e[2]))
+        elif e[0] == 'start':
+            node_type = RES_XML_START_ELEMENT_TYPE
+            if len(e) > 4:
+                comment = pool.index(e[4])
+            attrs = b''
+            for ns, name, res_id, raw, data_type, data in e[3]:
+                name_index = pool.attr_name(name, res_id) if res_id \
+                        else pool.index(name)
+                attrs += struct.pack('<IIIHBBI', pool.index(ns), name_index,
+                                     pool.index(raw), 8, 0, data_type,
+                                     data & 0xffffffff)
+            ext = struct.pack('<IIHHHHHH', pool.index(e[1]), pool.index(e[2]),
+                              20, 20, len(e[3]), 0, 0, 0) + attrs
+        elif e[0] == 'end':
+            node_type = RES_XML_END_ELEMENT_TYPE
+            ext = struct.pack('<II', pool.index(e[1]), pool.index(e[2]))
+        else:
+            node_type = RES_XML_CDATA_TYPE
+            ext = struct.pack('<IHBBI', pool.index(e[1]), 8, 0, 0, 0)
+        nodes += struct.pack('<HHIII', node_type, 16, 16 + len(ext), line,
+                             comment) + ext
+
+    body = string_pool(pool.strings, utf8)
+    if pool.res_ids:
+        body += struct.pack('<HHI', RES_XML_RESOURCE_MAP_TYPE, 8,
+                            8 + 4 * len(pool.res_ids))
+        body += b''.join(struct.pack('<I', r) for r in pool.res_ids)
+    body += nodes
+    return struct.pack('<HHI', RES_XML_TYPE, 8, 8 + len(body)) + body
+
+
+def float_bits(f):
+    return struct.unpack('<I', struct.pack('<f', f))[0]
+
+
+MANIFEST = [
+    ('ns', 'android', ANDROID),
+    ('ns', 'app', APP),
+    ('start', None, 'manifest', [
+        (ANDROID, 'versionCode', 0x0101021b, None, TYPE_INT_DEC, 42),
+        (ANDROID, 'versionName', 0x0101021c, '1.0 "beta" & <more>\'s',
+         TYPE_STRING, 0),
+        (None, 'package', 0, 'com.example.app', TYPE_STRING, 0),
+        (ANDROID, 'compileSdkVersion', 0x01010572, None, TYPE_INT_HEX, 0x1f),
+    ], 'top comment -- with dashes-'),
+    ('start', None, 'uses-sdk', [
+        (ANDROID, 'minSdkVersion', 0x0101020c, None, TYPE_INT_DEC, -5),
+        (ANDROID, 'targetSdkVersion', 0x01010270, None, TYPE_INT_DEC, 30),
+    ]),
+    ('end', None, 'uses-sdk'),
+    ('start', None, 'application', [
+        (ANDROID, 'label', 0x01010001, None, TYPE_REFERENCE, 0x7f0b0001),
+        (ANDROID, 'icon', 0x01010002, None, TYPE_REFERENCE, 0x7f080000),
+        (ANDROID, 'theme', 0x01010000, None, TYPE_ATTRIBUTE, 0x7f030004),
+        (ANDROID, 'debuggable', 0x0101000f, None, TYPE_INT_BOOLEAN,
+         0xffffffff),
+        (ANDROID, 'allowBackup', 0x01010280, None, TYPE_INT_BOOLEAN, 0),
+        (APP, 'layout_width', 0, None, TYPE_DIMENSION, (150 << 8) | 1),
+        (APP, 'weight', 0, None, TYPE_FLOAT, float_bits(0.5)),
+        (APP, 'fraction', 0, None, TYPE_FRACTION, (50 << 8) | 1),
+        (APP, 'color', 0, None, TYPE_INT_COLOR_ARGB8, 0xff336699),
+        (APP, 'nullish', 0, None, TYPE_NULL, 0),
+        (APP, 'dyn', 0, None, TYPE_DYNAMIC_REFERENCE, 0x00010002),
+        (APP, 'weird', 0, None, 0x30, 7),
+        (None, 'ctl', 0, 'tab\there\nnl\r\x01x', TYPE_STRING, 0),
+    ], 'app comment'),
+    ('start', None, 'activity', [
+        (ANDROID, 'name', 0x01010003, '.Mainé中\U0001F600',
+         TYPE_STRING, 0),
+        (ANDROID, 'exported', 0x01010010, None, TYPE_INT_BOOLEAN, 1),
+    ]),
+    ('text', 'Some <text> & "stuff"\t\x02'),
+    ('start', None, 'intent-filter', []),
+    ('start', None, 'action', [
+        (ANDROID, 'name', 0x01010003, 'android.intent.action.MAIN',
+         TYPE_STRING, 0),
+    ]),
+    ('end', None, 'action'),
+    ('end', None, 'intent-filter'),
+    ('text', 'tail'),
+    ('end', None, 'activity'),
+    ('start', ANDROID, 'meta-data', [
+        (ANDROID, 'name', 0x01010003, 'x', TYPE_STRING, 0),
+    ]),
+    ('start', None, 'deep', []),
+    ('text', ''),
+    ('end', None, 'deep'),
+    ('end', ANDROID, 'meta-data'),
+    ('start', 'http://unknown/ns', 'other', [
+        ('http://unknown/ns', 'foo', 0, 'bar', TYPE_STRING, 0),
+    ]),
+    ('end', 'http://unknown/ns', 'other'),
+    ('end', None, 'application'),
+    ('end', None, 'manifest'),
+    ('endns', 'app', APP),
+    ('endns', 'android', ANDROID),
+]
+
+ROOT = ('start', None, 'root', [
+    (ANDROID, 'name', 0x01010003, 'a & b', TYPE_STRING, 0),
+])
+CHILD = [
+    ('start', None, 'child', []),
+    ('text', 'child text'),
+    ('end', None, 'child'),
+]
+
+PRINTER = {
+    # Text is the document's first node, so no xmlns attributes are added
+    'text_before_root': [
+        ('ns', 'android', ANDROID),
+        ('text', 'lead <in> & "out"'),
+        ROOT, *CHILD, ('end', None, 'root'),
+        ('endns', 'android', ANDROID),
+    ],
+    'text_after_root': [
+        ('ns', 'android', ANDROID),
+        ROOT, *CHILD, ('end', None, 'root'),
+        ('text', 'trail'),
+        ('start', None, 'second', []),
+        ('end', None, 'second'),
+        ('endns', 'android', ANDROID),
+    ],
+    # The comment is the document's first node
+    'comment_before_root': [
+        ('ns', 'android', ANDROID),
+        ('start', None, 'root', [], 'first -- comment-'),
+        *CHILD,
+        ('end', None, 'root'),
+        ('endns', 'android', ANDROID),
+    ],
+    # Only the namespace that ends after the root is added to it
+    'namespace_before_root': [
+        ('ns', 'app', APP),
+        ('endns', 'app', APP),
+        ('ns', 'android', ANDROID),
+        ROOT, ('end', None, 'root'),
+        ('endns', 'android', ANDROID),
+    ],
+    'unmatched_end_tag': [
+        ('end', None, 'stray'),
+        ROOT, *CHILD, ('end', None, 'root'),
+        ('end', None, 'root'),
+        ('text', 'after'),
+    ],
+}
+
+
+def write(path, data):
+    with open(path, 'wb') as f:
+        f.write(data)
+
+
+def main():
+    data_dir = sys.argv[1] if len(sys.argv) > 1 \
+            else os.path.dirname(os.path.abspath(__file__))
+
+    write(os.path.join(data_dir, 'endian', 'utf8.axml'),
+          build(MANIFEST, utf8=True))
+    write(os.path.join(data_dir, 'endian', 'utf16.axml'),
+          build(MANIFEST, utf8=False))
+
+    printer_dir = os.path.join(data_dir, 'printer')
+    os.makedirs(printer_dir, exist_ok=True)
+    for name, events in sorted(PRINTER.items()):
+        write(os.path.join(printer_dir, name + '.axml'),
+              build(events, utf8=True))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Generates the archives in zip/ that zip_test reads:
+#
+#   valid.zip           stored.txt (stored) and deflated.txt (deflated)
+#   truncated_eocd.zip  valid.zip without the last 10 bytes, which cuts the
+#                       end of central directory record short
+#   bad_crc.zip         deflated.txt with a wrong CRC-32
+#   inflate_ratio.zip   deflated.txt claiming to inflate to 0x7fffffff bytes
+#   empty_deflated.zip  empty.txt, an empty deflated entry
+
+import io
+import os
+import struct
+import zipfile
+
+STORED = b'Stored entry\n'
+DEFLATED = b'Deflated entry\n' * 64
+
+CDE_SIGNATURE = b'PK\x01\x02'
+
+
+def build():
+    buf = io.BytesIO()
+    with zipfile.ZipFile(buf, 'w') as z:
+        # Fixed timestamps so that the output does not change
+        info = zipfile.ZipInfo('stored.txt', (2015, 1, 1, 0, 0, 0))
+        z.writestr(info, STORED, zipfile.ZIP_STORED)
+        info = zipfile.ZipInfo('deflated.txt', (2015, 1, 1, 0, 0, 0))
+        z.writestr(info, DEFLATED, zipfile.ZIP_DEFLATED)
+    return bytearray(buf.getvalue())
+
+
+# Returns the offsets of the local and central directory headers of name
+def find_headers(data, name):
+    cde = data.find(CDE_SIGNATURE)
+    while data[cde + 46:cde + 46 + len(name)] != name:
+        cde = data.find(CDE_SIGNATURE, cde + 1)
+        assert cde >= 0
+    lfh = struct.unpack_from('<I', data, cde + 42)[0]
+    return lfh, cde
+
+
+# Overwrites a 4-byte field of deflated.txt's local and central directory
+# headers
+def patch_deflated(data, lfh_offset, cde_offset, value):
+    lfh, cde = find_headers(data, b'deflated.txt')
+    struct.pack_into('<I', data, lfh + lfh_offset, value)
+    struct.pack_into('<I', data, cde + cde_offset, value)
+    return data
+
+
+def main():
+    out = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'zip')
+    os.makedirs(out, exist_ok=True)
+
+    def write(name, data):
+        with open(os.path.join(out, name), 'wb') as f:
+            f.write(data)
+
+    valid = build()
+    write('valid.zip', valid)
+    write('truncated_eocd.zip', valid[:-10])
+
+    _, cde = find_headers(valid, b'deflated.txt')
+    crc = struct.unpack_from('<I', valid, cde + 16)[0]
+    write('bad_crc.zip', patch_deflated(build(), 14, 16, crc ^ 1))
+    write('inflate_ratio.zip', patch_deflated(build(), 22, 24, 0x7fffffff))
+
+    buf = io.BytesIO()
+    with zipfile.ZipFile(buf, 'w') as z:
+        info = zipfile.ZipInfo('empty.txt', (2015, 1, 1, 0, 0, 0))
+        z.writestr(info, b'', zipfile.ZIP_DEFLATED)
+    write('empty_deflated.zip', buf.getvalue())
+
+
+if __name__ == '__main__':
+    main()
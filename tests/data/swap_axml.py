@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Converts a little-endian binary XML file or string pool chunk into the
+# byte order of a big-endian device, for the endian/*.be.* files that
+# endian_be_test reads.
+#
+# Usage: swap_axml.py <input> <output>
+
+import struct
+import sys
+
+RES_STRING_POOL_TYPE = 0x0001
+RES_XML_TYPE = 0x0003
+RES_XML_START_NAMESPACE_TYPE = 0x0100
+RES_XML_START_ELEMENT_TYPE = 0x0102
+RES_XML_CDATA_TYPE = 0x0104
+RES_XML_LAST_CHUNK_TYPE = 0x017f
+RES_XML_RESOURCE_MAP_TYPE = 0x0180
+
+UTF8_FLAG = 1 << 8
+
+
+def swap(buf, offset, fmt):
+    values = struct.unpack_from('<' + fmt, buf, offset)
+    struct.pack_into('>' + fmt, buf, offset, *values)
+
+
+def swap_pool(buf, offset):
+    header_size, size = struct.unpack_from('<HI', buf, offset + 2)
+    string_count, style_count, flags, strings_start, styles_start = \
+        struct.unpack_from('<IIIII', buf, offset + 8)
+    swap(buf, offset, 'HHIIIIII')
+
+    # String and style offsets
+    for i in range(string_count + style_count):
+        swap(buf, offset + header_size + 4 * i, 'I')
+
+    # UTF-8 strings are byte sequences; UTF-16 strings and their lengths
+    # are 16-bit units
+    strings_end = styles_start if style_count else size
+    if not flags & UTF8_FLAG:
+        for p in range(offset + strings_start, offset + strings_end - 1, 2):
+            swap(buf, p, 'H')
+
+    # Spans are made of 32-bit fields
+    if style_count:
+        for p in range(offset + styles_start, offset + size - 3, 4):
+            swap(buf, p, 'I')
+
+
+def swap_value(buf, offset):
+    swap(buf, offset, 'HBBI')
+
+
+def swap_node(buf, offset, chunk_type, header_size):
+    ext = offset + header_size
+    if chunk_type == RES_XML_START_ELEMENT_TYPE:
+        attr_start, attr_size, attr_count = \
+            struct.unpack_from('<HHH', buf, ext + 8)
+        for i in range(attr_count):
+            attr = ext + attr_start + attr_size * i
+            swap(buf, attr, 'III')
+            swap_value(buf, attr + 12)
+        swap(buf, ext, 'IIHHHHHH')
+    elif chunk_type == RES_XML_CDATA_TYPE:
+        swap(buf, ext, 'I')
+        swap_value(buf, ext + 4)
+    else:
+        # Namespaces and end tags both have two string references
+        swap(buf, ext, 'II')
+    swap(buf, offset, 'HHIII')
+
+
+# Swaps the chunk at offset and returns its size
+def swap_chunk(buf, offset):
+    chunk_type, header_size, size = struct.unpack_from('<HHI', buf, offset)
+
+    if chunk_type == RES_STRING_POOL_TYPE:
+        swap_pool(buf, offset)
+    elif chunk_type == RES_XML_TYPE:
+        swap(buf, offset, 'HHI')
+        p = offset + header_size
+        while p < offset + size:
+            p += swap_chunk(buf, p)
+    elif chunk_type == RES_XML_RESOURCE_MAP_TYPE:
+        for p in range(offset + header_size, offset + size, 4):
+            swap(buf, p, 'I')
+        swap(buf, offset, 'HHI')
+    elif RES_XML_START_NAMESPACE_TYPE <= chunk_type <= RES_XML_LAST_CHUNK_TYPE:
+        swap_node(buf, offset, chunk_type, header_size)
+    else:
+        swap(buf, offset, 'HHI')
+
+    return size
+
+
+def main():
+    if len(sys.argv) != 3:
+        print('Usage: %s <input> <output>' % sys.argv[0], file=sys.stderr)
+        sys.exit(1)
+
+    with open(sys.argv[1], 'rb') as f:
+        buf = bytearray(f.read())
+    swap_chunk(buf, 0)
+    with open(sys.argv[2], 'wb') as f:
+        f.write(buf)
+
+
+if __name__ == '__main__':
+    main()
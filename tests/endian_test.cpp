@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Parses the documents and string pools in tests/data/endian and compares
+// their strings, styles and parser events with the <name>.txt listings.
+//
+// This is built twice: as endian_test, which reads the little-endian
+// originals, and as endian_be_test, which is built with
+// DEVICE_BYTE_ORDER=BIG_ENDIAN and reads the *.be.* copies made by
+// tests/data/swap_axml.py. Both must produce the same listings.
+//
+// With --update, the listings are rewritten instead.
+
+#include <string>
+#include <vector>
+
+#include <cstdarg>
+#include <cstring>
+
+#include <androidfw/ResourceTypes.h>
+#include <utils/ByteOrder.h>
+#include <utils/String8.h>
+
+#include "check.h"
+
+using namespace android;
+
+static const bool kBigEndianData = DEVICE_BYTE_ORDER == BIG_ENDIAN;
+
+static bool read_file(const std::string &path, std::string *out)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+    char buf[4096];
+    size_t n;
+    out->clear();
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        out->append(buf, n);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool write_file(const std::string &path, const std::string &data)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    const bool ret = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    return fclose(fp) == 0 && ret;
+}
+
+// Appends str in quotes, with control characters escaped so that every
+// listing entry stays on one line
+static void append_string(std::string *out, const char16_t *str, size_t len)
+{
+    if (!str) {
+        *out += "null";
+        return;
+    }
+    const String8 str8(str, len);
+    *out += '"';
+    for (size_t i = 0; i < str8.size(); ++i) {
+        const unsigned char c = str8.string()[i];
+        if (c < 0x20 || c == '"' || c == '\\') {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\x%02x", c);
+            *out += buf;
+        } else {
+            *out += (char) c;
+        }
+    }
+    *out += '"';
+}
+
+static void appendf(std::string *out, const char *fmt, ...)
+        __attribute__((format(printf, 2, 3)));
+
+static void appendf(std::string *out, const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    *out += buf;
+}
+
+static void list_pool(std::string *out, const ResStringPool &pool)
+{
+    appendf(out, "pool: %zu strings, %zu styles, utf8=%d, sorted=%d\n",
+            pool.size(), pool.styleCount(), pool.isUTF8(), pool.isSorted());
+    for (size_t i = 0; i < pool.size(); ++i) {
+        size_t len;
+        const char16_t *str = pool.stringAt(i, &len);
+        appendf(out, "string %zu: ", i);
+        append_string(out, str, len);
+        if (str) {
+            appendf(out, " (index %zd)", pool.indexOfString(str, len));
+        }
+        *out += '\n';
+    }
+    for (size_t i = 0; i < pool.styleCount(); ++i) {
+        appendf(out, "style %zu:", i);
+        for (const ResStringPool_span *span = pool.styleAt(i);
+                span && span->name.index != ResStringPool_span::END; ++span) {
+            appendf(out, " %u[%u,%u]", span->name.index, span->firstChar,
+                    span->lastChar);
+        }
+        *out += '\n';
+    }
+}
+
+static void list_events(std::string *out, ResXMLParser *parser)
+{
+    size_t len;
+    const char16_t *str;
+    ResXMLParser::event_code_t code;
+    while ((code = parser->next()) != ResXMLParser::END_DOCUMENT
+            && code != ResXMLParser::BAD_DOCUMENT) {
+        appendf(out, "line %u: ", parser->getLineNumber());
+        switch (code) {
+        case ResXMLParser::START_NAMESPACE:
+        case ResXMLParser::END_NAMESPACE:
+            *out += code == ResXMLParser::START_NAMESPACE
+                    ? "start namespace " : "end namespace ";
+            str = parser->getNamespacePrefix(&len);
+            append_string(out, str, len);
+            *out += ' ';
+            str = parser->getNamespaceUri(&len);
+            append_string(out, str, len);
+            break;
+        case ResXMLParser::START_TAG:
+        case ResXMLParser::END_TAG:
+            *out += code == ResXMLParser::START_TAG ? "start " : "end ";
+            str = parser->getElementNamespace(&len);
+            append_string(out, str, len);
+            *out += ' ';
+            str = parser->getElementName(&len);
+            append_string(out, str, len);
+            if (code == ResXMLParser::END_TAG) {
+                break;
+            }
+            for (size_t i = 0; i < parser->getAttributeCount(); ++i) {
+                *out += "\n    attribute ";
+                str = parser->getAttributeNamespace(i, &len);
+                append_string(out, str, len);
+                *out += ' ';
+                str = parser->getAttributeName(i, &len);
+                append_string(out, str, len);
+                Res_value value;
+                parser->getAttributeValue(i, &value);
+                appendf(out, " resid=0x%08x type=0x%02x data=0x%08x raw=",
+                        parser->getAttributeNameResID(i), value.dataType,
+                        value.data);
+                str = parser->getAttributeStringValue(i, &len);
+                append_string(out, str, len);
+            }
+            break;
+        case ResXMLParser::TEXT:
+            *out += "text ";
+            str = parser->getText(&len);
+            append_string(out, str, len);
+            break;
+        default:
+            appendf(out, "event %d", (int) code);
+            break;
+        }
+        *out += '\n';
+    }
+    appendf(out, "end: %s\n", code == ResXMLParser::END_DOCUMENT
+            ? "END_DOCUMENT" : "BAD_DOCUMENT");
+}
+
+// Compares the listing of one file with <name>.txt
+static void check_file(const std::string &dir, const char *name,
+                       const char *ext, bool update)
+{
+    const std::string path = dir + "/" + name
+            + (kBigEndianData ? ".be" : "") + ext;
+    const std::string expectedPath = dir + "/" + name + ".txt";
+
+    std::string data;
+    if (!read_file(path, &data)) {
+        fprintf(stderr, "Error: Failed to read %s\n", path.c_str());
+        ++g_failures;
+        return;
+    }
+
+    std::string listing;
+    if (strcmp(ext, ".axml") == 0) {
+        ResXMLTree tree;
+        if (tree.setTo(data.data(), data.size(), true) != NO_ERROR) {
+            fprintf(stderr, "Error: Failed to parse %s\n", path.c_str());
+            ++g_failures;
+            return;
+        }
+        list_pool(&listing, tree.getStrings());
+        list_events(&listing, &tree);
+    } else {
+        ResStringPool pool;
+        if (pool.setTo(data.data(), data.size(), true) != NO_ERROR) {
+            fprintf(stderr, "Error: Failed to parse %s\n", path.c_str());
+            ++g_failures;
+            return;
+        }
+        list_pool(&listing, pool);
+    }
+
+    if (update) {
+        if (!write_file(expectedPath, listing)) {
+            fprintf(stderr, "Error: Failed to write %s\n",
+                    expectedPath.c_str());
+            ++g_failures;
+        }
+        return;
+    }
+
+    std::string expected;
+    if (!read_file(expectedPath, &expected)) {
+        fprintf(stderr, "Error: Failed to read %s\n", expectedPath.c_str());
+        ++g_failures;
+    } else if (listing != expected) {
+        fprintf(stderr, "%s does not match %s:\n%s",
+                path.c_str(), expectedPath.c_str(), listing.c_str());
+        ++g_failures;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const bool update = argc == 3 && strcmp(argv[2], "--update") == 0;
+    if (argc != 2 && !update) {
+        fprintf(stderr, "Usage: %s <tests/data> [--update]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const std::string dir = std::string(argv[1]) + "/endian";
+
+    check_file(dir, "utf8", ".axml", update);
+    check_file(dir, "utf16", ".axml", update);
+    check_file(dir, "styled_utf8", ".bin", update);
+    check_file(dir, "styled_utf16", ".bin", update);
+
+    return test_result();
+}
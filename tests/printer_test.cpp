@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Prints the documents in tests/data/printer and tests/data/endian with
+// streamXML() and compares the output with printer/<name>.xml. Those files
+// are what pugixml's xml_node::print() writes, so with WITH_PUGIXML, the
+// output of printXML() is compared with them too.
+//
+// With --update, the files are rewritten from printXML() instead, which
+// needs WITH_PUGIXML.
+
+#include <string>
+
+#include <cstring>
+
+#include <androidfw/ResourceTypes.h>
+#include <utils/StringArena.h>
+
+#include "check.h"
+#include "xml_printer.h"
+
+using namespace android;
+
+static bool read_file(const std::string &path, std::string *out)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+    char buf[4096];
+    size_t n;
+    out->clear();
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        out->append(buf, n);
+    }
+    fclose(fp);
+    return true;
+}
+
+#ifdef WITH_PUGIXML
+static bool write_file(const std::string &path, const std::string &data)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    const bool ret = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    return fclose(fp) == 0 && ret;
+}
+#endif
+
+typedef void (*print_fn)(ResXMLTree *, FILE *, const resource_names *,
+                         StringArena *);
+
+// Prints tree with print and returns the output
+static std::string print_to_string(print_fn print, ResXMLTree *tree,
+                                   const resource_names *resNames)
+{
+    std::string out;
+    FILE *fp = tmpfile();
+    if (!fp) {
+        perror("tmpfile");
+        return out;
+    }
+    StringArena arena;
+    print(tree, fp, resNames, &arena);
+    rewind(fp);
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        out.append(buf, n);
+    }
+    fclose(fp);
+    return out;
+}
+
+static void check_output(const char *printer, const std::string &path,
+                         const std::string &output,
+                         const std::string &expected)
+{
+    if (output != expected) {
+        fprintf(stderr, "%s: %s output differs\n--- expected\n%s\n"
+                "--- %s\n%s\n", path.c_str(), printer, expected.c_str(),
+                printer, output.c_str());
+        ++g_failures;
+    }
+}
+
+// Prints <dir>/<input> and compares it with <dir>/printer/<name>.xml
+static void check_file(const std::string &dir, const char *input,
+                       const char *name, const resource_names *resNames,
+                       bool update)
+{
+    const std::string path = dir + "/" + input;
+    const std::string expectedPath = dir + "/printer/" + name + ".xml";
+
+    std::string data;
+    if (!read_file(path, &data)) {
+        fprintf(stderr, "%s: Failed to read file\n", path.c_str());
+        ++g_failures;
+        return;
+    }
+
+    ResXMLTree tree;
+    if (tree.setTo(data.data(), data.size(), true) != NO_ERROR) {
+        fprintf(stderr, "%s: Failed to parse file\n", path.c_str());
+        ++g_failures;
+        return;
+    }
+
+#ifdef WITH_PUGIXML
+    const std::string dom = print_to_string(printXML, &tree, resNames);
+    if (update) {
+        if (!write_file(expectedPath, dom)) {
+            fprintf(stderr, "%s: Failed to write file\n",
+                    expectedPath.c_str());
+            ++g_failures;
+        }
+        return;
+    }
+#endif
+
+    std::string expected;
+    if (!read_file(expectedPath, &expected)) {
+        fprintf(stderr, "%s: Failed to read file\n", expectedPath.c_str());
+        ++g_failures;
+        return;
+    }
+
+#ifdef WITH_PUGIXML
+    check_output("printXML", path, dom, expected);
+#endif
+    check_output("streamXML", path,
+                 print_to_string(streamXML, &tree, resNames), expected);
+}
+
+int main(int argc, char *argv[])
+{
+    const bool update = argc == 3 && strcmp(argv[1], "--update") == 0;
+    if (argc != 2 && !update) {
+        fprintf(stderr, "Usage: %s [--update] <tests/data directory>\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+#ifndef WITH_PUGIXML
+    if (update) {
+        fprintf(stderr, "--update needs a build with WITH_PUGIXML\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    const std::string dir = argv[argc - 1];
+    static const struct {
+        const char *input;
+        const char *name;
+    } files[] = {
+        { "printer/comment_before_root.axml", "comment_before_root" },
+        { "printer/namespace_before_root.axml", "namespace_before_root" },
+        { "printer/text_after_root.axml", "text_after_root" },
+        { "printer/text_before_root.axml", "text_before_root" },
+        { "printer/unmatched_end_tag.axml", "unmatched_end_tag" },
+        { "endian/utf8.axml", "manifest_utf8" },
+        { "endian/utf16.axml", "manifest_utf16" },
+    };
+
+    // Some references are printed by name, the rest by ID
+    resource_names resNames;
+    resNames[0x7f0b0001] = "string/app_name";
+    resNames[0x7f030004] = "attr/theme";
+
+    for (const auto &file : files) {
+        check_file(dir, file.input, file.name, &resNames, update);
+    }
+
+    return test_result();
+}
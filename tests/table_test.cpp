@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reads the resource tables in tests/data/table, which are generated by
+// tests/data/gen_arsc.py.
+
+#include <string>
+
+#include <androidfw/ResourceTypes.h>
+#include <logging.h>
+
+#include "check.h"
+
+using namespace android;
+
+static std::string g_dir;
+
+static status_t open_table(ResTable *table, const char *name)
+{
+    return table->setToFile((g_dir + "/table/" + name).c_str());
+}
+
+// Returns "type/name" for resID, or "" if it has no name
+static std::string resource_name(const ResTable &table, uint32_t resID)
+{
+    ResTable::resource_name name;
+    if (!table.getResourceName(resID, true, &name)
+            || !name.type8 || !name.name8) {
+        return std::string();
+    }
+    return std::string(name.type8, name.typeLen) + "/"
+            + std::string(name.name8, name.nameLen);
+}
+
+// Returns the data of resID if it is a plain value of type dataType, or -1
+static int64_t resource_data(const ResTable &table, uint32_t resID,
+                             uint8_t dataType)
+{
+    Res_value value;
+    if (table.getResource(resID, &value) != NO_ERROR
+            || value.dataType != dataType) {
+        return -1;
+    }
+    return value.data;
+}
+
+static void test_type_id_offset()
+{
+    ResTable table;
+    CHECK(open_table(&table, "type_id_offset.arsc") == NO_ERROR);
+    CHECK(table.getTypeCount(0x7f) == 4);
+    CHECK(table.getEntryCount(0x7f, 3) == 1);
+    CHECK(table.getEntryCount(0x7f, 4) == 2);
+
+    // Type names are looked up below the offset
+    CHECK(resource_name(table, 0x7f030000) == "layout/main");
+    CHECK(resource_name(table, 0x7f040000) == "string/hello");
+    CHECK(resource_name(table, 0x7f040001) == "string/world");
+    CHECK(resource_name(table, 0x7f010000).empty());
+    CHECK(resource_name(table, 0x7f050000).empty());
+    CHECK(resource_data(table, 0x7f040001, Res_value::TYPE_STRING) == 1);
+}
+
+static void test_bad_type_id()
+{
+    ResTable table;
+    CHECK(open_table(&table, "bad_type_id.arsc") == BAD_TYPE);
+}
+
+static void test_sparse()
+{
+    ResTable table;
+    CHECK(open_table(&table, "sparse.arsc") == NO_ERROR);
+    CHECK(table.getEntryCount(0x7f, 1) == 6);
+
+    // The dense default configuration comes first and wins
+    CHECK(resource_name(table, 0x7f010000) == "string/hello");
+    CHECK(resource_data(table, 0x7f010001, Res_value::TYPE_STRING) == 1);
+
+    // Only defined in the sparse configuration
+    CHECK(resource_name(table, 0x7f010005) == "string/sparse");
+    CHECK(resource_data(table, 0x7f010005, Res_value::TYPE_INT_DEC) == 5);
+    for (uint32_t e = 2; e < 5; ++e) {
+        CHECK(resource_name(table, 0x7f010000 | e).empty());
+    }
+}
+
+static void test_unknown_flags()
+{
+    ResTable table;
+    CHECK(open_table(&table, "unknown_flags.arsc") == NO_ERROR);
+
+    // Only the chunk with unknown flags is skipped
+    CHECK(resource_name(table, 0x7f010000) == "string/hello");
+    CHECK(resource_data(table, 0x7f010000, Res_value::TYPE_STRING) == 0);
+}
+
+static void test_bad_entries()
+{
+    ResTable table;
+    CHECK(open_table(&table, "bad_entries.arsc") == NO_ERROR);
+    CHECK(table.getEntryCount(0x7f, 1) == 5);
+
+    // Out of bounds, misaligned, bad size and bad key index
+    for (uint32_t e = 0; e < 4; ++e) {
+        Res_value value;
+        CHECK(table.getResource(0x7f010000 | e, &value) == BAD_INDEX);
+        CHECK(resource_name(table, 0x7f010000 | e).empty());
+    }
+
+    CHECK(resource_name(table, 0x7f010004) == "string/world");
+    CHECK(resource_data(table, 0x7f010004, Res_value::TYPE_INT_DEC) == 4);
+}
+
+static void discard_log(void *, int, const char *, const char *)
+{
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <tests/data>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    g_dir = argv[1];
+
+    // The corrupt tables are expected to log warnings
+    setLogSink(discard_log);
+
+    test_type_id_offset();
+    test_bad_type_id();
+    test_sparse();
+    test_unknown_flags();
+    test_bad_entries();
+
+    return test_result();
+}
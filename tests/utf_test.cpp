@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs the UTF-8 <-> UTF-16 conversions in libutils/Unicode.cpp with every
+// kernel the CPU supports and compares the results with the scalar kernel.
+// The inputs are ASCII runs around the 16 and 32 unit block sizes with
+// non-ASCII characters and truncated sequences at every offset.
+
+#include <string>
+#include <vector>
+
+#include <utils/Unicode.h>
+
+#include "check.h"
+
+// Longest input; covers a few 32 unit blocks plus a partial one
+static const size_t kMaxLen = 100;
+
+struct utf8_result {
+    ssize_t length;
+    std::u16string converted;
+};
+
+struct utf16_result {
+    ssize_t length;
+    std::string converted;
+};
+
+static utf8_result convert_utf8(const std::string &s)
+{
+    const uint8_t *src = (const uint8_t *) s.data();
+    utf8_result r;
+    r.length = utf8_to_utf16_length(src, s.size());
+    // utf8_to_utf16() expects input that utf8_to_utf16_length() accepted
+    if (r.length >= 0) {
+        std::vector<char16_t> buf(r.length + 2, 0xffff);
+        utf8_to_utf16(src, s.size(), buf.data());
+        r.converted.assign(buf.data(), buf.size());
+    }
+    return r;
+}
+
+static utf16_result convert_utf16(const std::u16string &s)
+{
+    utf16_result r;
+    r.length = utf16_to_utf8_length(s.data(), s.size());
+    if (r.length >= 0) {
+        std::vector<char> buf(r.length + 2, '\xff');
+        utf16_to_utf8(s.data(), s.size(), buf.data());
+        r.converted.assign(buf.data(), buf.size());
+    }
+    return r;
+}
+
+// UTF-8 strings of ASCII with insert placed at every offset
+static void add_utf8(std::vector<std::string> *out, const std::string &insert)
+{
+    for (size_t len = insert.size(); len <= kMaxLen; ++len) {
+        for (size_t pos = 0; pos + insert.size() <= len; ++pos) {
+            std::string s;
+            for (size_t i = 0; i < pos; ++i) {
+                s += (char) ('a' + i % 26);
+            }
+            s += insert;
+            while (s.size() < len) {
+                s += (char) ('A' + s.size() % 26);
+            }
+            out->push_back(s);
+        }
+    }
+}
+
+static void add_utf16(std::vector<std::u16string> *out,
+                      const std::u16string &insert)
+{
+    for (size_t len = insert.size(); len <= kMaxLen; ++len) {
+        for (size_t pos = 0; pos + insert.size() <= len; ++pos) {
+            std::u16string s;
+            for (size_t i = 0; i < pos; ++i) {
+                s += (char16_t) ('a' + i % 26);
+            }
+            s += insert;
+            while (s.size() < len) {
+                s += (char16_t) ('A' + s.size() % 26);
+            }
+            out->push_back(s);
+        }
+    }
+}
+
+static std::vector<std::string> utf8_inputs()
+{
+    std::vector<std::string> inputs;
+    add_utf8(&inputs, "");
+    add_utf8(&inputs, "\x7f");
+    add_utf8(&inputs, "\xc2\x80");          // U+0080
+    add_utf8(&inputs, "\xc3\xa9");          // U+00E9
+    add_utf8(&inputs, "\xe4\xb8\xad");      // U+4E2D
+    add_utf8(&inputs, "\xf0\x9f\x98\x80");  // U+1F600
+    add_utf8(&inputs, "\xc3\xa9\xe4\xb8\xad");
+
+    // Sequences cut short, which are only invalid at the end of the input
+    std::vector<std::string> truncated;
+    for (const char *seq : { "\xc3", "\xe4\xb8", "\xe4", "\xf0\x9f\x98",
+                             "\xf0\x9f", "\xf0" }) {
+        for (size_t len = 0; len < kMaxLen; ++len) {
+            std::string s;
+            for (size_t i = 0; i < len; ++i) {
+                s += (char) ('a' + i % 26);
+            }
+            inputs.push_back(s + seq);
+        }
+    }
+    return inputs;
+}
+
+static std::vector<std::u16string> utf16_inputs()
+{
+    std::vector<std::u16string> inputs;
+    add_utf16(&inputs, u"");
+    add_utf16(&inputs, u"\u007f");
+    add_utf16(&inputs, u"\u0080");
+    add_utf16(&inputs, u"é");
+    add_utf16(&inputs, u"中");
+    add_utf16(&inputs, u"\U0001f600");
+    add_utf16(&inputs, u"é中");
+    // Unpaired surrogates
+    add_utf16(&inputs, std::u16string(1, (char16_t) 0xd83d));
+    add_utf16(&inputs, std::u16string(1, (char16_t) 0xde00));
+    add_utf16(&inputs, std::u16string(u"é") + (char16_t) 0xd83d);
+    return inputs;
+}
+
+static const char *kernel_name(int kernel)
+{
+    switch (kernel) {
+    case UTF_KERNEL_SCALAR: return "scalar";
+    case UTF_KERNEL_SSE2: return "sse2";
+    case UTF_KERNEL_AVX2: return "avx2";
+    default: return "?";
+    }
+}
+
+int main()
+{
+    const int defaultKernel = utf_current_kernel();
+    const std::vector<std::string> u8 = utf8_inputs();
+    const std::vector<std::u16string> u16 = utf16_inputs();
+
+    CHECK(utf_select_kernel(UTF_KERNEL_SCALAR) == 0);
+    std::vector<utf8_result> u8Expected;
+    for (const std::string &s : u8) {
+        u8Expected.push_back(convert_utf8(s));
+    }
+    std::vector<utf16_result> u16Expected;
+    for (const std::u16string &s : u16) {
+        u16Expected.push_back(convert_utf16(s));
+    }
+
+    for (int kernel : { UTF_KERNEL_SSE2, UTF_KERNEL_AVX2 }) {
+        if (utf_select_kernel(kernel) != 0) {
+            printf("Skipping %s: not supported by this CPU\n",
+                   kernel_name(kernel));
+            continue;
+        }
+
+        for (size_t i = 0; i < u8.size(); ++i) {
+            const utf8_result r = convert_utf8(u8[i]);
+            if (r.length != u8Expected[i].length
+                    || r.converted != u8Expected[i].converted) {
+                fprintf(stderr, "%s: UTF-8 input %zu (length %zu) differs "
+                        "from scalar\n", kernel_name(kernel), i,
+                        u8[i].size());
+                ++g_failures;
+            }
+        }
+        for (size_t i = 0; i < u16.size(); ++i) {
+            const utf16_result r = convert_utf16(u16[i]);
+            if (r.length != u16Expected[i].length
+                    || r.converted != u16Expected[i].converted) {
+                fprintf(stderr, "%s: UTF-16 input %zu (length %zu) differs "
+                        "from scalar\n", kernel_name(kernel), i,
+                        u16[i].size());
+                ++g_failures;
+            }
+        }
+    }
+
+    // The scalar results themselves, for a few inputs
+    CHECK(u8Expected[0].length == 0);
+    utf_select_kernel(UTF_KERNEL_SCALAR);
+    CHECK(convert_utf8(std::string(40, 'a') + "\xc3\xa9").converted
+            == std::u16string(40, u'a') + u"é" + u'\0' + (char16_t) 0xffff);
+    CHECK(convert_utf8(std::string(40, 'a') + "\xe4\xb8").length == -1);
+    CHECK(convert_utf16(std::u16string(40, u'a') + u"\U0001f600").converted
+            == std::string(40, 'a') + "\xf0\x9f\x98\x80" + '\0' + '\xff');
+
+    utf_select_kernel(defaultKernel);
+
+    return test_result();
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reads the archives in tests/data/zip, which are generated by
+// tests/data/gen_zip.py.
+
+#include <string>
+#include <vector>
+
+#include <cstring>
+
+#include <androidfw/ZipFileRO.h>
+#include <logging.h>
+
+#include "check.h"
+
+using namespace android;
+
+static std::string g_dir;
+
+static std::string zip_path(const char *name)
+{
+    return g_dir + "/zip/" + name;
+}
+
+// Returns the result of getEntryData() for the entry called name
+static status_t read_entry(const ZipFileRO &zip, const char *name,
+                           std::string *out)
+{
+    const ssize_t idx = zip.findEntry(name);
+    if (idx < 0) {
+        return idx;
+    }
+    std::vector<uint8_t> buffer;
+    const void *data;
+    size_t size;
+    status_t err = zip.getEntryData(idx, &buffer, &data, &size);
+    if (err == NO_ERROR) {
+        out->assign((const char *) data, size);
+    }
+    return err;
+}
+
+static void test_valid()
+{
+    ZipFileRO zip;
+    CHECK(zip.open(zip_path("valid.zip").c_str()) == NO_ERROR);
+    CHECK(zip.getNumEntries() == 2);
+
+    std::string data;
+    CHECK(read_entry(zip, "stored.txt", &data) == NO_ERROR);
+    CHECK(data == "Stored entry\n");
+
+    std::string expected;
+    for (int i = 0; i < 64; ++i) {
+        expected += "Deflated entry\n";
+    }
+    CHECK(read_entry(zip, "deflated.txt", &data) == NO_ERROR);
+    CHECK(data == expected);
+
+    CHECK(zip.findEntry("missing.txt") == NAME_NOT_FOUND);
+}
+
+static void test_truncated_eocd()
+{
+    ZipFileRO zip;
+    CHECK(zip.open(zip_path("truncated_eocd.zip").c_str()) == BAD_TYPE);
+    CHECK(zip.getNumEntries() == 0);
+}
+
+static void test_bad_crc()
+{
+    ZipFileRO zip;
+    CHECK(zip.open(zip_path("bad_crc.zip").c_str()) == NO_ERROR);
+
+    // Only the corrupt entry is unreadable
+    std::string data;
+    CHECK(read_entry(zip, "stored.txt", &data) == NO_ERROR);
+    CHECK(read_entry(zip, "deflated.txt", &data) == BAD_TYPE);
+}
+
+static void test_inflate_ratio()
+{
+    ZipFileRO zip;
+    CHECK(zip.open(zip_path("inflate_ratio.zip").c_str()) == NO_ERROR);
+
+    // Rejected before the buffer is allocated
+    std::vector<uint8_t> buffer;
+    const void *data;
+    size_t size;
+    const ssize_t idx = zip.findEntry("deflated.txt");
+    CHECK(idx >= 0);
+    CHECK(zip.getEntryData(idx, &buffer, &data, &size) == BAD_TYPE);
+    CHECK(buffer.empty());
+}
+
+static void test_empty_deflated()
+{
+    ZipFileRO zip;
+    CHECK(zip.open(zip_path("empty_deflated.zip").c_str()) == NO_ERROR);
+
+    // The buffer has nowhere to inflate to while it is still empty
+    std::string data = "x";
+    CHECK(read_entry(zip, "empty.txt", &data) == NO_ERROR);
+    CHECK(data.empty());
+}
+
+static void discard_log(void *, int, const char *, const char *)
+{
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <tests/data>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    g_dir = argv[1];
+
+    // The corrupt archives are expected to log warnings
+    setLogSink(discard_log);
+
+    test_valid();
+    test_truncated_eocd();
+    test_bad_crc();
+    test_inflate_ratio();
+    test_empty_deflated();
+
+    return test_result();
+}
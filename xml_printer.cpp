@@ -0,0 +1,879 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cstring>
+
+#include <androidfw/ResourceTypes.h>
+
+#include <utils/ByteOrder.h>
+#include <utils/String8.h>
+#include <utils/StringArena.h>
+#include <utils/Unicode.h>
+
+#ifdef WITH_PUGIXML
+#include <pugixml.hpp>
+#endif
+
+#include "xml_printer.h"
+
+using namespace android;
+
+static const std::string * find_resource_name(const resource_names *names,
+                                              uint32_t resId)
+{
+    if (!names) {
+        return NULL;
+    }
+    resource_names::const_iterator it = names->find(resId);
+    return it == names->end() ? NULL : &it->second;
+}
+
+// The namespaces in scope, looked up by the string pool index of the URI.
+// URIs are matched by their contents (the outermost match wins), but the
+// result for each pool index is cached until the next namespace starts or
+// ends, so resolving the namespace of an element or attribute is normally a
+// single array access.
+class namespace_map
+{
+public:
+    struct entry {
+        int32_t uriId;
+        const char16_t *uri;
+        size_t uriLen;
+        // Already converted to UTF-8
+        std::string prefix;
+    };
+
+    explicit namespace_map(const ResStringPool &strings)
+        : mStrings(strings), mGeneration(1), mCache(strings.size())
+    {
+    }
+
+    bool empty() const { return mEntries.empty(); }
+    const entry & back() const { return mEntries.back(); }
+
+    void push(int32_t uriId, const char *prefix, size_t prefixLen)
+    {
+        entry e;
+        e.uriId = uriId;
+        e.uri = uriId >= 0 ? mStrings.stringAt(uriId, &e.uriLen) : NULL;
+        e.uriLen = e.uri ? strnlen16(e.uri, e.uriLen) : 0;
+        e.prefix.assign(prefix, prefixLen);
+        mEntries.push_back(std::move(e));
+        ++mGeneration;
+    }
+
+    void pop()
+    {
+        mEntries.pop_back();
+        ++mGeneration;
+    }
+
+    // Returns the prefix for the URI at pool index uriId, or NULL if it is not
+    // the URI of any namespace in scope.
+    const std::string * find(int32_t uriId)
+    {
+        if (uriId < 0 || (size_t) uriId >= mCache.size()) {
+            return NULL;
+        }
+        slot &s = mCache[uriId];
+        if (s.generation != mGeneration) {
+            s.generation = mGeneration;
+            s.index = lookup(uriId);
+        }
+        return s.index >= 0 ? &mEntries[s.index].prefix : NULL;
+    }
+
+private:
+    struct slot {
+        uint32_t generation;
+        int32_t index;
+    };
+
+    int32_t lookup(int32_t uriId) const
+    {
+        size_t len;
+        const char16_t *uri = mStrings.stringAt(uriId, &len);
+        if (!uri) {
+            return -1;
+        }
+        len = strnlen16(uri, len);
+        for (size_t i = 0; i < mEntries.size(); ++i) {
+            const entry &e = mEntries[i];
+            if (e.uriId == uriId || (e.uriLen == len
+                    && strzcmp16(e.uri, e.uriLen, uri, len) == 0)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    const ResStringPool &mStrings;
+    std::vector<entry> mEntries;
+    uint32_t mGeneration;
+    std::vector<slot> mCache;
+};
+
+// The UTF-8 form of every string of a pool, converted the first time it is
+// needed and kept for the rest of the document. Strings of UTF-8 pools point
+// straight into the pool when they are plain ASCII; everything else is
+// converted the way String8(const char16_t *) does it (the string ends at the
+// first NUL) into arena.
+class utf8_strings
+{
+public:
+    utf8_strings(const ResStringPool &strings, StringArena *arena)
+        : mStrings(strings), mArena(arena), mSlots(strings.size())
+    {
+    }
+
+    // Returns string idx, or NULL if there is no such string.
+    const char * get(int32_t idx, size_t *outLen)
+    {
+        if (idx < 0 || (size_t) idx >= mSlots.size()) {
+            *outLen = 0;
+            return NULL;
+        }
+        slot &s = mSlots[idx];
+        if (!s.done) {
+            s.str = convert(idx, &s.len);
+            s.done = true;
+        }
+        *outLen = s.len;
+        return s.str;
+    }
+
+private:
+    struct slot {
+        const char *str;
+        size_t len;
+        bool done;
+    };
+
+    const char * convert(int32_t idx, size_t *outLen)
+    {
+        size_t len;
+        if (mStrings.isUTF8()) {
+            const char *s8 = mStrings.string8At(idx, &len);
+            // Anything else may be changed by a round trip through UTF-16
+            if (s8 && s8[len] == '\0' && is_ascii(s8, len)) {
+                *outLen = len;
+                return s8;
+            }
+        }
+        const char16_t *s16 = mStrings.stringAt(idx, &len);
+        if (!s16) {
+            *outLen = 0;
+            return NULL;
+        }
+        return mArena->toUTF8(s16, len, outLen);
+    }
+
+    static bool is_ascii(const char *s, size_t len)
+    {
+        for (size_t i = 0; i < len; ++i) {
+            const unsigned char c = s[i];
+            if (c == 0 || c >= 0x80) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const ResStringPool &mStrings;
+    StringArena *mArena;
+    std::vector<slot> mSlots;
+};
+
+// Handles a START_NAMESPACE event. Namespaces without a prefix get "<DEF>".
+static void start_namespace(const ResXMLParser &parser,
+                            namespace_map *namespaces, utf8_strings *utf8)
+{
+    size_t len;
+    const char *prefix = utf8->get(parser.getNamespacePrefixID(), &len);
+    if (prefix) {
+        namespaces->push(parser.getNamespaceUriID(), prefix, len);
+    } else {
+        namespaces->push(parser.getNamespaceUriID(), "<DEF>", 5);
+    }
+}
+
+// Handles an END_NAMESPACE event: reports it if it does not match the
+// innermost namespace and pops that. Returns false if there is none;
+// otherwise, its prefix and URI ("" if it has none) are stored in prefix and
+// uri.
+static bool end_namespace(const ResXMLParser &parser,
+                          namespace_map *namespaces, utf8_strings *utf8,
+                          std::string *prefix, std::string *uri)
+{
+    if (namespaces->empty()) {
+        fprintf(stderr, "Error: Unmatched end namespace\n");
+        return false;
+    }
+    const namespace_map::entry &ns = namespaces->back();
+    size_t len;
+    const char *nsUri = utf8->get(ns.uriId, &len);
+    if (!nsUri) {
+        nsUri = "";
+    }
+    const char *pr = utf8->get(parser.getNamespacePrefixID(), &len);
+    if (!pr) {
+        pr = "<DEF>";
+    }
+    if (ns.prefix != pr) {
+        fprintf(stderr, "Error: Bad end namespace prefix: found=%s, expected=%s\n",
+                pr, ns.prefix.c_str());
+    }
+
+    const char *endUri = utf8->get(parser.getNamespaceUriID(), &len);
+    if (!endUri) {
+        endUri = "";
+    }
+    if (strcmp(nsUri, endUri) != 0) {
+        fprintf(stderr, "Error: Bad end namespace URI: found=%s, expected=%s\n",
+                endUri, nsUri);
+    }
+
+    *prefix = ns.prefix;
+    *uri = nsUri;
+    namespaces->pop();
+    return true;
+}
+
+#ifdef WITH_PUGIXML
+// Returns the name of an element or attribute, with the namespace URI (if
+// any) replaced by its prefix. The string lives in arena.
+static const char * build_name(StringArena *arena, namespace_map *namespaces,
+                               utf8_strings *utf8, int32_t nsId,
+                               int32_t nameId)
+{
+    const char *prefix = NULL;
+    size_t prefixLen = 0;
+    if (nsId >= 0) {
+        const std::string *found = namespaces->find(nsId);
+        if (found) {
+            prefix = found->data();
+            prefixLen = found->size();
+        } else {
+            prefix = utf8->get(nsId, &prefixLen);
+        }
+    }
+
+    size_t nameLen;
+    const char *name = utf8->get(nameId, &nameLen);
+    arena->begin();
+    if (prefix) {
+        arena->append(prefix, prefixLen);
+        arena->append(":", 1);
+    }
+    arena->append(name, nameLen);
+    return arena->finish();
+}
+#endif
+
+static String8 complexToString(uint32_t complex, bool isFraction)
+{
+    const float MANTISSA_MULT =
+            1.0f / (1 << Res_value::COMPLEX_MANTISSA_SHIFT);
+    const float RADIX_MULTS[] = {
+        1.0f * MANTISSA_MULT, 1.0f / (1 << 7) * MANTISSA_MULT,
+        1.0f / (1 << 15) * MANTISSA_MULT, 1.0f / (1 << 23) * MANTISSA_MULT
+    };
+
+    float value = (complex & (Res_value::COMPLEX_MANTISSA_MASK
+                    << Res_value::COMPLEX_MANTISSA_SHIFT))
+            * RADIX_MULTS[(complex >> Res_value::COMPLEX_RADIX_SHIFT)
+                    & Res_value::COMPLEX_RADIX_MASK];
+
+    String8 result = String8::format("%f", value);
+
+    if (!isFraction) {
+        switch ((complex >> Res_value::COMPLEX_UNIT_SHIFT)
+                & Res_value::COMPLEX_UNIT_MASK) {
+        case Res_value::COMPLEX_UNIT_PX: result.append("px"); break;
+        case Res_value::COMPLEX_UNIT_DIP: result.append("dp"); break;
+        case Res_value::COMPLEX_UNIT_SP: result.append("sp"); break;
+        case Res_value::COMPLEX_UNIT_PT: result.append("pt"); break;
+        case Res_value::COMPLEX_UNIT_IN: result.append("in"); break;
+        case Res_value::COMPLEX_UNIT_MM: result.append("mm"); break;
+        default: result.append(" (unknown unit)"); break;
+        }
+    } else {
+        switch ((complex >> Res_value::COMPLEX_UNIT_SHIFT)
+                & Res_value::COMPLEX_UNIT_MASK) {
+        case Res_value::COMPLEX_UNIT_FRACTION: result.append("%"); break;
+        case Res_value::COMPLEX_UNIT_FRACTION_PARENT: result.append("%p"); break;
+        default: result.append(" (unknown unit)"); break;
+        }
+    }
+
+    return result;
+}
+
+#ifdef WITH_PUGIXML
+void printXML(ResXMLTree *block, FILE *fp, const resource_names *resNames,
+              StringArena *arena)
+{
+    pugi::xml_document doc;
+
+    // Holds the converted pool strings and the element and attribute names
+    // until the document is done; pugixml makes its own copies anyway
+    arena->reset();
+
+    std::vector<pugi::xml_node> stack;
+
+    block->restart();
+
+    const ResStringPool &strings = block->getStrings();
+    namespace_map namespaces(strings);
+    utf8_strings utf8(strings, arena);
+
+    ResXMLTree::event_code_t code;
+    while ((code = block->next()) != ResXMLTree::END_DOCUMENT
+            && code != ResXMLTree::BAD_DOCUMENT) {
+        if (code == ResXMLTree::START_TAG) {
+            // Get parent node
+            pugi::xml_node &parent = stack.empty() ? doc : stack.back();
+
+            size_t len;
+
+            // Get comment (if any)
+            const char *comment = utf8.get(block->getCommentID(), &len);
+            if (comment) {
+                parent.append_child(pugi::node_comment).set_value(comment);
+            }
+
+            // Get element name
+            const char *name = build_name(arena, &namespaces, &utf8,
+                                          block->getElementNamespaceID(),
+                                          block->getElementNameID());
+
+            // Add to stack
+            stack.push_back(parent.append_child(name));
+
+            pugi::xml_node &current = stack.back();
+
+            // Add attributes
+            for (const ResXMLParser::ResXMLAttribute &a
+                    : block->getAttributes()) {
+                // Attribute name
+                name = build_name(arena, &namespaces, &utf8, a.ns, a.name);
+
+                pugi::xml_attribute attr = current.append_attribute(name);
+
+                // Attribute value
+                const Res_value &value = a.typedValue;
+                char str[64];
+                if (value.dataType == Res_value::TYPE_NULL) {
+                    // Empty attribute
+                } else if (value.dataType == Res_value::TYPE_REFERENCE
+                        || value.dataType == Res_value::TYPE_DYNAMIC_REFERENCE
+                        || value.dataType == Res_value::TYPE_ATTRIBUTE) {
+                    const char prefix =
+                            value.dataType == Res_value::TYPE_ATTRIBUTE ? '?' : '@';
+                    const std::string *resName =
+                            find_resource_name(resNames, value.data);
+                    if (resName) {
+                        attr = (prefix + *resName).c_str();
+                    } else {
+                        snprintf(str, sizeof(str), "%c0x%08x", prefix, value.data);
+                        attr = str;
+                    }
+                } else if (value.dataType == Res_value::TYPE_STRING) {
+                    const char *str8 = utf8.get(a.rawValue, &len);
+                    attr = str8 ? str8 : "";
+                } else if (value.dataType == Res_value::TYPE_FLOAT) {
+                    float f;
+                    memcpy(&f, &value.data, sizeof(f));
+                    attr = f;
+                } else if (value.dataType == Res_value::TYPE_DIMENSION) {
+                    attr = complexToString(value.data, false);
+                } else if (value.dataType == Res_value::TYPE_FRACTION) {
+                    attr = complexToString(value.data, true);
+                } else if (value.dataType >= Res_value::TYPE_FIRST_COLOR_INT
+                        && value.dataType <= Res_value::TYPE_LAST_COLOR_INT) {
+                    snprintf(str, sizeof(str), "#%08x", value.data);
+                    attr = str;
+                } else if (value.dataType == Res_value::TYPE_INT_BOOLEAN) {
+                    attr = value.data ? "true" : "false";
+                } else if (value.dataType == Res_value::TYPE_INT_DEC) {
+                    attr = value.data;
+                } else if (value.dataType >= Res_value::TYPE_FIRST_INT
+                        && value.dataType <= Res_value::TYPE_LAST_INT) {
+                    snprintf(str, sizeof(str), "0x%x", value.data);
+                    attr = str;
+                } else {
+                    snprintf(str, sizeof(str), "(unknown: type=0x%x, value=0x%x)",
+                             value.dataType, value.data);
+                    attr = str;
+                }
+            }
+        } else if (code == ResXMLTree::END_TAG) {
+            if (!stack.empty()) {
+                stack.pop_back();
+            }
+        } else if (code == ResXMLTree::START_NAMESPACE) {
+            start_namespace(*block, &namespaces, &utf8);
+        } else if (code == ResXMLTree::END_NAMESPACE) {
+            std::string prefix;
+            std::string uri;
+            if (!end_namespace(*block, &namespaces, &utf8, &prefix, &uri)) {
+                continue;
+            }
+
+            // Hackish, but we don't need a full-blown XML library with
+            // namespaces support. pugixml only adds attributes to elements,
+            // so nothing happens if the first node is a comment or text.
+            pugi::xml_node child = doc.first_child();
+            if (child) {
+                std::string attrName("xmlns:");
+                attrName.append(prefix);
+                child.append_attribute(attrName.c_str()) = uri.c_str();
+            }
+        } else if (code == ResXMLTree::TEXT) {
+            size_t len;
+
+            pugi::xml_node &current = stack.empty() ? doc : stack.back();
+            const char *text = utf8.get(block->getTextID(), &len);
+            current.append_child(pugi::node_pcdata).set_value(text ? text : "");
+        }
+    }
+
+    block->restart();
+
+    pugi::xml_writer_file writer(fp);
+    doc.print(writer);
+}
+#endif
+
+// Buffered output sink for streamXML(). Text is only handed to stdio in large
+// chunks.
+class xml_sink
+{
+public:
+    explicit xml_sink(FILE *fp) : mFp(fp), mLen(0) {}
+    ~xml_sink() { flush(); }
+
+    void put(char c)
+    {
+        if (mLen == sizeof(mBuf)) {
+            flush();
+        }
+        mBuf[mLen++] = c;
+    }
+
+    void write(const char *s, size_t n)
+    {
+        if (n > sizeof(mBuf) - mLen) {
+            flush();
+            if (n > sizeof(mBuf)) {
+                fwrite(s, 1, n, mFp);
+                return;
+            }
+        }
+        memcpy(mBuf + mLen, s, n);
+        mLen += n;
+    }
+
+    void write(const char *s)
+    {
+        write(s, strlen(s));
+    }
+
+    void indent(size_t depth)
+    {
+        for (size_t i = 0; i < depth; ++i) {
+            put('\t');
+        }
+    }
+
+    void flush()
+    {
+        if (mLen > 0) {
+            fwrite(mBuf, 1, mLen, mFp);
+            mLen = 0;
+        }
+    }
+
+private:
+    FILE *mFp;
+    char mBuf[65536];
+    size_t mLen;
+};
+
+// Writes text with the escaping pugixml applies to PCDATA or, if isAttr is
+// set, to attribute values.
+static void write_escaped(xml_sink *sink, const char *s, size_t len,
+                          bool isAttr)
+{
+    const char *end = s + len;
+    while (s < end) {
+        const char *run = s;
+        while (s < end) {
+            const unsigned char c = *s;
+            if (c == '&' || c == '<' || c == '>' || (isAttr && c == '"')
+                    || (c < 32 && (isAttr
+                            || (c != '\t' && c != '\r' && c != '\n')))) {
+                break;
+            }
+            ++s;
+        }
+        sink->write(run, s - run);
+        if (s == end) {
+            break;
+        }
+
+        const unsigned char c = *s++;
+        switch (c) {
+        case '&': sink->write("&amp;", 5); break;
+        case '<': sink->write("&lt;", 4); break;
+        case '>': sink->write("&gt;", 4); break;
+        case '"': sink->write("&quot;", 6); break;
+        default: {
+            char ref[6] = { '&', '#', char('0' + c / 10), char('0' + c % 10),
+                            ';', 0 };
+            sink->write(ref, 5);
+            break;
+        }
+        }
+    }
+}
+
+// Writes a comment the way pugixml does, breaking up "--" and a trailing
+// "-" so that the comment cannot end early.
+static void write_comment(xml_sink *sink, const char *s, size_t len)
+{
+    const char *end = s + len;
+    sink->write("<!--", 4);
+    while (s < end) {
+        const char *run = s;
+        while (s < end && !(s[0] == '-' && (s + 1 == end || s[1] == '-'))) {
+            ++s;
+        }
+        sink->write(run, s - run);
+        if (s < end) {
+            sink->write("- ", 2);
+            ++s;
+        }
+    }
+    sink->write("-->", 3);
+}
+
+// Appends the name of an element or attribute to out, replacing the
+// namespace URI by its prefix as build_name() does.
+static void append_name(std::string *out, namespace_map *namespaces,
+                        utf8_strings *utf8, int32_t nsId, int32_t nameId)
+{
+    const char *s;
+    size_t len;
+    if (nsId >= 0) {
+        const std::string *found = namespaces->find(nsId);
+        if (found) {
+            out->append(*found);
+            out->push_back(':');
+        } else if ((s = utf8->get(nsId, &len))) {
+            out->append(s, len);
+            out->push_back(':');
+        }
+    }
+    s = utf8->get(nameId, &len);
+    out->append(s ? s : "", len);
+}
+
+static void write_attribute_value(xml_sink *sink, utf8_strings *utf8,
+                                  const ResXMLParser::ResXMLAttribute &attr,
+                                  const resource_names *resNames)
+{
+    const Res_value &value = attr.typedValue;
+
+    char str[64];
+    size_t len;
+    const char *s = str;
+
+    if (value.dataType == Res_value::TYPE_NULL) {
+        return;
+    } else if (value.dataType == Res_value::TYPE_REFERENCE
+            || value.dataType == Res_value::TYPE_DYNAMIC_REFERENCE
+            || value.dataType == Res_value::TYPE_ATTRIBUTE) {
+        const char prefix =
+                value.dataType == Res_value::TYPE_ATTRIBUTE ? '?' : '@';
+        const std::string *resName = find_resource_name(resNames, value.data);
+        if (resName) {
+            sink->put(prefix);
+            write_escaped(sink, resName->data(), resName->size(), true);
+            return;
+        }
+        snprintf(str, sizeof(str), "%c0x%08x", prefix, value.data);
+    } else if (value.dataType == Res_value::TYPE_STRING) {
+        s = utf8->get(attr.rawValue, &len);
+        if (s) {
+            write_escaped(sink, s, len, true);
+        }
+        return;
+    } else if (value.dataType == Res_value::TYPE_FLOAT) {
+        float f;
+        memcpy(&f, &value.data, sizeof(f));
+        snprintf(str, sizeof(str), "%.9g", (double) f);
+    } else if (value.dataType == Res_value::TYPE_DIMENSION
+            || value.dataType == Res_value::TYPE_FRACTION) {
+        String8 result = complexToString(
+                value.data, value.dataType == Res_value::TYPE_FRACTION);
+        write_escaped(sink, result.string(), result.size(), true);
+        return;
+    } else if (value.dataType >= Res_value::TYPE_FIRST_COLOR_INT
+            && value.dataType <= Res_value::TYPE_LAST_COLOR_INT) {
+        snprintf(str, sizeof(str), "#%08x", value.data);
+    } else if (value.dataType == Res_value::TYPE_INT_BOOLEAN) {
+        s = value.data ? "true" : "false";
+    } else if (value.dataType == Res_value::TYPE_INT_DEC) {
+        snprintf(str, sizeof(str), "%u", value.data);
+    } else if (value.dataType >= Res_value::TYPE_FIRST_INT
+            && value.dataType <= Res_value::TYPE_LAST_INT) {
+        snprintf(str, sizeof(str), "0x%x", value.data);
+    } else {
+        snprintf(str, sizeof(str), "(unknown: type=0x%x, value=0x%x)",
+                 value.dataType, value.data);
+    }
+
+    write_escaped(sink, s, strlen(s), true);
+}
+
+// printXML() adds an xmlns attribute to the document's first node for every
+// END_NAMESPACE that comes after the node was added, if the node is an
+// element rather than a comment or text. Those events come after the root
+// element has been written, so find them in a separate pass first.
+static void scan_xmlns(const ResXMLTree *block, utf8_strings *utf8,
+                       std::vector<std::pair<std::string, std::string>> *out)
+{
+    enum { FIRST_NONE, FIRST_ELEMENT, FIRST_OTHER } first = FIRST_NONE;
+    ResXMLParser parser(*block);
+    parser.restart();
+    namespace_map namespaces(block->getStrings());
+    size_t depth = 0;
+    size_t len;
+
+    ResXMLParser::event_code_t code;
+    while ((code = parser.next()) != ResXMLParser::END_DOCUMENT
+            && code != ResXMLParser::BAD_DOCUMENT) {
+        if (code == ResXMLParser::START_TAG) {
+            // An element's comment is added in front of it
+            if (depth == 0 && first == FIRST_NONE) {
+                first = utf8->get(parser.getCommentID(), &len)
+                        ? FIRST_OTHER : FIRST_ELEMENT;
+            }
+            ++depth;
+        } else if (code == ResXMLParser::END_TAG) {
+            if (depth > 0) {
+                --depth;
+            }
+        } else if (code == ResXMLParser::TEXT) {
+            if (depth == 0 && first == FIRST_NONE) {
+                first = FIRST_OTHER;
+            }
+        } else if (code == ResXMLParser::START_NAMESPACE) {
+            start_namespace(parser, &namespaces, utf8);
+        } else if (code == ResXMLParser::END_NAMESPACE) {
+            std::string prefix;
+            std::string uri;
+            if (end_namespace(parser, &namespaces, utf8, &prefix, &uri)
+                    && first == FIRST_ELEMENT) {
+                out->push_back(std::make_pair("xmlns:" + prefix, uri));
+            }
+        }
+    }
+}
+
+void streamXML(ResXMLTree *block, FILE *fp, const resource_names *resNames,
+               StringArena *arena)
+{
+    // Indentation state, as tracked by pugixml's printer
+    enum { INDENT_NEWLINE = 1, INDENT_INDENT = 2 };
+
+    xml_sink sink(fp);
+    const ResStringPool &strings = block->getStrings();
+    arena->reset();
+    utf8_strings utf8(strings, arena);
+
+    std::vector<std::pair<std::string, std::string>> xmlns;
+    scan_xmlns(block, &utf8, &xmlns);
+
+    // Names of the open elements, stored back to back in names
+    std::string names;
+    std::vector<size_t> stack;
+    std::string attrName;
+    namespace_map namespaces(strings);
+    // Whether the start tag of the innermost element still needs its '>'
+    bool startTagOpen = false;
+    bool firstElement = true;
+    unsigned int flags = INDENT_INDENT;
+    size_t len;
+
+    auto closeElement = [&]() {
+        if (startTagOpen) {
+            sink.write(" />", 3);
+            startTagOpen = false;
+        } else {
+            if (flags & INDENT_NEWLINE) sink.put('\n');
+            if (flags & INDENT_INDENT) sink.indent(stack.size() - 1);
+            sink.write("</", 2);
+            sink.write(names.data() + stack.back(),
+                       names.size() - stack.back());
+            sink.put('>');
+        }
+        names.resize(stack.back());
+        stack.pop_back();
+        flags = INDENT_NEWLINE | INDENT_INDENT;
+    };
+
+    block->restart();
+
+    ResXMLTree::event_code_t code;
+    while ((code = block->next()) != ResXMLTree::END_DOCUMENT
+            && code != ResXMLTree::BAD_DOCUMENT) {
+        if (code == ResXMLTree::START_TAG) {
+            if (startTagOpen) {
+                sink.put('>');
+                startTagOpen = false;
+            }
+
+            const char *comment = utf8.get(block->getCommentID(), &len);
+            if (comment) {
+                if (flags & INDENT_NEWLINE) sink.put('\n');
+                if (flags & INDENT_INDENT) sink.indent(stack.size());
+                write_comment(&sink, comment, len);
+                flags = INDENT_NEWLINE | INDENT_INDENT;
+                firstElement = false;
+            }
+
+            if (flags & INDENT_NEWLINE) sink.put('\n');
+            if (flags & INDENT_INDENT) sink.indent(stack.size());
+            sink.put('<');
+
+            // Keep the name around for the end tag
+            stack.push_back(names.size());
+            append_name(&names, &namespaces, &utf8,
+                        block->getElementNamespaceID(),
+                        block->getElementNameID());
+            sink.write(names.data() + stack.back(),
+                       names.size() - stack.back());
+
+            for (const ResXMLParser::ResXMLAttribute &attr
+                    : block->getAttributes()) {
+                attrName.clear();
+                append_name(&attrName, &namespaces, &utf8, attr.ns,
+                            attr.name);
+                sink.put(' ');
+                sink.write(attrName.data(), attrName.size());
+                sink.write("=\"", 2);
+                write_attribute_value(&sink, &utf8, attr, resNames);
+                sink.put('"');
+            }
+
+            if (firstElement) {
+                for (const auto &attr : xmlns) {
+                    sink.put(' ');
+                    sink.write(attr.first.data(), attr.first.size());
+                    sink.write("=\"", 2);
+                    write_escaped(&sink, attr.second.data(),
+                                  attr.second.size(), true);
+                    sink.put('"');
+                }
+                firstElement = false;
+            }
+
+            startTagOpen = true;
+            flags = INDENT_NEWLINE | INDENT_INDENT;
+        } else if (code == ResXMLTree::END_TAG) {
+            if (stack.empty()) {
+                continue;
+            }
+            closeElement();
+        } else if (code == ResXMLTree::START_NAMESPACE) {
+            start_namespace(*block, &namespaces, &utf8);
+        } else if (code == ResXMLTree::END_NAMESPACE) {
+            // Reported by scan_xmlns() already
+            if (!namespaces.empty()) {
+                namespaces.pop();
+            }
+        } else if (code == ResXMLTree::TEXT) {
+            // Text outside of the root element is printed like any other
+            if (startTagOpen) {
+                sink.put('>');
+                startTagOpen = false;
+            }
+            const char *text = utf8.get(block->getTextID(), &len);
+            if (text) {
+                write_escaped(&sink, text, len, false);
+            }
+            flags = 0;
+        }
+    }
+
+    // Close whatever is left open if the document was truncated
+    while (!stack.empty()) {
+        closeElement();
+    }
+    if (flags & INDENT_NEWLINE) {
+        sink.put('\n');
+    }
+
+    block->restart();
+}
+
+static void append_utf(std::string *out, const char16_t *s16, const char *s8,
+                       size_t len)
+{
+    if (s8) {
+        out->append(s8, len);
+    } else if (s16) {
+        String8 str(s16, len);
+        out->append(str.string(), str.size());
+    }
+}
+
+void add_resource_names(resource_names *names, const ResTable &table)
+{
+    for (size_t p = 0; p < table.getPackageCount(); ++p) {
+        const uint32_t pkgId = table.getPackageId(p);
+        const size_t typeCount = table.getTypeCount(pkgId);
+        for (uint32_t t = 1; t <= typeCount; ++t) {
+            const size_t entryCount = table.getEntryCount(pkgId, t);
+            for (uint32_t e = 0; e < entryCount; ++e) {
+                const uint32_t resId = (pkgId << 24) | (t << 16) | e;
+                ResTable::resource_name name;
+                if (names->count(resId)
+                        || !table.getResourceName(resId, true, &name)) {
+                    continue;
+                }
+
+                std::string str;
+                if (pkgId != 0x7f && name.package) {
+                    append_utf(&str, name.package, NULL, name.packageLen);
+                    str += ':';
+                }
+                append_utf(&str, name.type, name.type8, name.typeLen);
+                str += '/';
+                append_utf(&str, name.name, name.name8, name.nameLen);
+                names->emplace(resId, std::move(str));
+            }
+        }
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2015 Andrew Gunnerson <andrewgunnerson@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Conversion of binary XML documents back to text, shared by axml2xml and
+// the benchmarks.
+//
+
+#ifndef AXML_XML_PRINTER_H
+#define AXML_XML_PRINTER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+#include <androidfw/ResourceTypes.h>
+#include <utils/StringArena.h>
+
+// Resource ID to "type/name" (or "package:type/name" outside of the app's
+// package), built once from the tables given with -r
+typedef std::unordered_map<uint32_t, std::string> resource_names;
+
+#ifdef WITH_PUGIXML
+// Builds the document with pugixml and prints it. References to resources
+// found in resNames (which may be NULL) are printed by name. arena is reset
+// and holds the strings of this document.
+void printXML(android::ResXMLTree *block, FILE *fp,
+              const resource_names *resNames, android::StringArena *arena);
+#endif
+
+// Writes the same document as printXML(), but straight from the parser
+// events without building a DOM first.
+void streamXML(android::ResXMLTree *block, FILE *fp,
+               const resource_names *resNames, android::StringArena *arena);
+
+// Adds the name of every resource in table to names. Resources outside of the
+// app's package (0x7f) are qualified with their package name, the way aapt
+// prints references to framework resources. IDs already present are kept so
+// that the first table given on the command line wins.
+void add_resource_names(resource_names *names, const android::ResTable &table);
+
+#endif // AXML_XML_PRINTER_H